@@ -0,0 +1,327 @@
+/* SYNAPSE SO - Kernel Microbenchmarks Implementation */
+/* Licensed under GPLv3 */
+
+#include <kernel/bench.h>
+#include <kernel/cpu.h>
+#include <kernel/vmm.h>
+#include <kernel/pmm.h>
+#include <kernel/heap.h>
+#include <kernel/vga.h>
+#include <kernel/elf.h>
+#include <kernel/vma.h>
+#include <kernel/process.h>
+#include <kernel/scheduler.h>
+#include <kernel/fork.h>
+#include <kernel/exec.h>
+#include <kernel/const.h>
+#include <kernel/string.h>
+
+/* Where the spawn benchmark maps the parent's pages (the first holds the
+   program image) and where the program runs */
+#define BENCH_SPAWN_DATA  0x08000000U
+#define BENCH_SPAWN_ENTRY 0x08048000U
+
+/* Disable interrupts, returning the previous EFLAGS */
+static inline uint32_t bench_irq_save(void) {
+    uint32_t flags;
+    __asm__ volatile("pushf; pop %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+static inline void bench_irq_restore(uint32_t flags) {
+    if (flags & (1 << 9)) {
+        __asm__ volatile("sti" ::: "memory");
+    }
+}
+
+/* Touch one byte in each page, like a switch touching kernel stacks and
+   process structures */
+static void touch_pages(volatile uint8_t* pages) {
+    for (uint32_t i = 0; i < BENCH_TOUCH_PAGES; i++) {
+        pages[i * PAGE_SIZE]++;
+    }
+}
+
+/* Average cycles for a round trip to another address space and back */
+static uint32_t switch_round_trips(page_directory_t* home,
+                                   page_directory_t* other,
+                                   volatile uint8_t* pages,
+                                   uint32_t iterations) {
+    uint32_t total = 0;
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint64_t start = cpu_rdtsc();
+
+        vmm_switch_page_directory(other);
+        touch_pages(pages);
+        vmm_switch_page_directory(home);
+        touch_pages(pages);
+
+        total += (uint32_t)(cpu_rdtsc() - start);
+    }
+
+    return total / iterations;
+}
+
+/* Measure the cost of switching address spaces */
+void bench_context_switch(uint32_t iterations) {
+    if (!cpu_has_feature(CPU_FEATURE_TSC)) {
+        vga_print("[-] bench: No time stamp counter\n");
+        return;
+    }
+
+    if (iterations == 0) {
+        iterations = 1;
+    }
+
+    page_directory_t* home = vmm_get_current_directory();
+    page_directory_t* other = vmm_create_page_directory();
+    if (other == 0) {
+        return;
+    }
+
+    volatile uint8_t* pages =
+        (volatile uint8_t*)kmalloc(BENCH_TOUCH_PAGES * PAGE_SIZE);
+    if (pages == 0) {
+        vmm_destroy_page_directory(other);
+        return;
+    }
+
+    uint32_t flags = bench_irq_save();
+
+    /* Warm up caches and the TLB */
+    switch_round_trips(home, other, pages, 1);
+
+    uint32_t cycles = switch_round_trips(home, other, pages, iterations);
+
+    /* Run again with global pages turned off, so kernel entries are
+       flushed on every CR3 reload */
+    uint32_t cycles_no_global = 0;
+    int global = vmm_set_global_pages(0);
+    if (global) {
+        cycles_no_global = switch_round_trips(home, other, pages, iterations);
+        vmm_set_global_pages(1);
+    }
+
+    bench_irq_restore(flags);
+
+    kfree((void*)pages);
+    vmm_destroy_page_directory(other);
+
+    vga_print("Address space round trip (");
+    vga_print_dec(BENCH_TOUCH_PAGES);
+    vga_print(" kernel pages touched per side, ");
+    vga_print_dec(iterations);
+    vga_print(" iterations):\n");
+    if (global) {
+        vga_print("  Global pages:    ");
+        vga_print_dec(cycles);
+        vga_print(" cycles\n");
+        vga_print("  No global pages: ");
+        vga_print_dec(cycles_no_global);
+        vga_print(" cycles\n");
+    } else {
+        vga_print("  ");
+        vga_print_dec(cycles);
+        vga_print(" cycles (global pages not supported)\n");
+    }
+}
+
+/* Write a minimal program, one text segment a page long, to data */
+static void bench_write_program(uint8_t* data) {
+    memset(data, 0, PAGE_SIZE);
+
+    elf32_header_t* header = (elf32_header_t*)data;
+    memcpy(header->e_ident, ELFMAG, SELFMAG);
+    header->e_ident[4] = ELFCLASS32;
+    header->e_ident[5] = ELFDATA2LSB;
+    header->e_ident[6] = EV_CURRENT;
+    header->e_type = ET_EXEC;
+    header->e_machine = EM_386;
+    header->e_version = EV_CURRENT;
+    header->e_entry = BENCH_SPAWN_ENTRY;
+    header->e_phoff = sizeof(elf32_header_t);
+    header->e_ehsize = sizeof(elf32_header_t);
+    header->e_phentsize = sizeof(elf32_phdr_t);
+    header->e_phnum = 1;
+
+    elf32_phdr_t* phdr = (elf32_phdr_t*)(data + header->e_phoff);
+    phdr->p_type = PT_LOAD;
+    phdr->p_vaddr = BENCH_SPAWN_ENTRY;
+    phdr->p_paddr = BENCH_SPAWN_ENTRY;
+    phdr->p_filesz = PAGE_SIZE;
+    phdr->p_memsz = PAGE_SIZE;
+    phdr->p_flags = PF_R | PF_X;
+    phdr->p_align = PAGE_SIZE;
+}
+
+/* Tear down a process the benchmark started, the way a failed spawn
+   does */
+static void bench_process_destroy(process_t* proc) {
+    scheduler_remove_process(proc);
+    vmm_destroy_page_directory(proc->page_dir);
+    process_destroy(proc);
+}
+
+/* Make proc the running process, on its own address space */
+static void bench_enter(process_t* proc) {
+    process_set_current(proc);
+    vmm_switch_page_directory(proc->page_dir);
+}
+
+/* A user process to start the program from: BENCH_CLONE_PAGES pages of
+   its own for fork to clone, the first holding the program image, and a
+   kernel stack with a trap frame for fork to copy */
+static process_t* bench_parent_create(void) {
+    process_t* parent = process_create("bench", 0, 0);
+    if (parent == 0) {
+        return 0;
+    }
+
+    uint32_t end = BENCH_SPAWN_DATA + BENCH_CLONE_PAGES * PAGE_SIZE;
+    if ((vma_add(parent, BENCH_SPAWN_DATA, end, VMA_READ | VMA_WRITE) != 0) ||
+        (process_init_user_stack(parent, BENCH_SPAWN_ENTRY) != 0)) {
+        bench_process_destroy(parent);
+        return 0;
+    }
+
+    uint32_t* frames = (uint32_t*)kmalloc(BENCH_CLONE_PAGES *
+                                          sizeof(uint32_t));
+    if (frames == 0) {
+        bench_process_destroy(parent);
+        return 0;
+    }
+    if (pmm_alloc_frames_bulk(frames, BENCH_CLONE_PAGES) != 0) {
+        kfree(frames);
+        bench_process_destroy(parent);
+        return 0;
+    }
+    if (vmm_map_range_in(parent->page_dir, BENCH_SPAWN_DATA, frames,
+                         BENCH_CLONE_PAGES,
+                         PAGE_PRESENT | PAGE_WRITE | PAGE_USER) != 0) {
+        pmm_free_frames_bulk(frames, BENCH_CLONE_PAGES);
+        kfree(frames);
+        bench_process_destroy(parent);
+        return 0;
+    }
+
+    uint32_t program = vmm_kmap_atomic(frames[0]);
+    bench_write_program((uint8_t*)program);
+    vmm_kunmap_atomic(program);
+
+    kfree(frames);
+    return parent;
+}
+
+/* Average cycles for the parent to fork and for the child to exec the
+   program; 0 if either fails */
+static uint32_t fork_exec_runs(process_t* parent, uint32_t iterations) {
+    uint32_t total = 0;
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint64_t start = cpu_rdtsc();
+
+        pid_t pid = do_fork();
+        process_t* child = (pid > 0) ? process_find_by_pid(pid) : 0;
+        if (child == 0) {
+            vga_print("[-] bench: fork failed\n");
+            return 0;
+        }
+
+        /* exec runs in the child, on the child's address space */
+        bench_enter(child);
+        int status = do_exec((const char*)BENCH_SPAWN_DATA, 0);
+
+        total += (uint32_t)(cpu_rdtsc() - start);
+
+        bench_enter(parent);
+        bench_process_destroy(child);
+        if (status != 0) {
+            vga_print("[-] bench: exec failed\n");
+            return 0;
+        }
+    }
+
+    return total / iterations;
+}
+
+/* Average cycles for the parent to spawn the program; 0 if it fails */
+static uint32_t spawn_runs(uint32_t iterations) {
+    uint32_t total = 0;
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint64_t start = cpu_rdtsc();
+
+        pid_t pid = do_spawn((const char*)BENCH_SPAWN_DATA, 0);
+
+        total += (uint32_t)(cpu_rdtsc() - start);
+
+        process_t* child = (pid > 0) ? process_find_by_pid(pid) : 0;
+        if (child == 0) {
+            vga_print("[-] bench: spawn failed\n");
+            return 0;
+        }
+        bench_process_destroy(child);
+    }
+
+    return total / iterations;
+}
+
+/* Measure fork+exec against spawn */
+void bench_spawn(uint32_t iterations) {
+    if (!cpu_has_feature(CPU_FEATURE_TSC)) {
+        vga_print("[-] bench: No time stamp counter\n");
+        return;
+    }
+
+    if (iterations == 0) {
+        iterations = 1;
+    }
+
+    /* The children never run: they are torn down before interrupts come
+       back on */
+    uint32_t flags = bench_irq_save();
+
+    process_t* home = process_get_current();
+    page_directory_t* home_dir = vmm_get_current_directory();
+
+    process_t* parent = bench_parent_create();
+    if (parent == 0) {
+        bench_irq_restore(flags);
+        vga_print("[-] bench: Failed to set up parent process\n");
+        return;
+    }
+    bench_enter(parent);
+
+    /* Warm up caches and the TLB */
+    uint32_t cycles_fork = 0;
+    uint32_t cycles_spawn = 0;
+    if ((fork_exec_runs(parent, 1) != 0U) && (spawn_runs(1) != 0U)) {
+        cycles_fork = fork_exec_runs(parent, iterations);
+        if (cycles_fork != 0U) {
+            cycles_spawn = spawn_runs(iterations);
+        }
+    }
+
+    process_set_current(home);
+    vmm_switch_page_directory(home_dir);
+    bench_process_destroy(parent);
+
+    bench_irq_restore(flags);
+
+    if ((cycles_fork == 0U) || (cycles_spawn == 0U)) {
+        return;
+    }
+
+    vga_print("Starting a program (");
+    vga_print_dec(BENCH_CLONE_PAGES);
+    vga_print(" parent pages, ");
+    vga_print_dec(iterations);
+    vga_print(" iterations, console output included):\n");
+    vga_print("  fork + exec: ");
+    vga_print_dec(cycles_fork);
+    vga_print(" cycles\n");
+    vga_print("  spawn:       ");
+    vga_print_dec(cycles_spawn);
+    vga_print(" cycles\n");
+}
@@ -209,6 +209,22 @@ void cpu_enable_features(void) {
         vga_print("    SSE enabled\n");
     }
     
+    /* Enable 4MB pages if available */
+    if (cpu_has_feature(CPU_FEATURE_PSE)) {
+        uint32_t cr4;
+        __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+        cr4 |= (1 << 4);  /* PSE */
+        __asm__ volatile("mov %0, %%cr4" : : "r"(cr4));
+        vga_print("    Large pages enabled\n");
+    }
+
+    /* Make kernel writes honour read-only PTEs, so copies into user
+       space break copy-on-write sharing instead of writing through it */
+    uint32_t cr0;
+    __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+    cr0 |= (1 << 16);  /* WP */
+    __asm__ volatile("mov %0, %%cr0" : : "r"(cr0));
+
     /* Enable global pages if available */
     if (cpu_has_feature(CPU_FEATURE_PGE)) {
         uint32_t cr4;
@@ -6,28 +6,86 @@
 #include <kernel/vmm.h>
 #include <kernel/pmm.h>
 #include <kernel/elf.h>
+#include <kernel/image.h>
 #include <kernel/heap.h>
 #include <kernel/vga.h>
 #include <kernel/string.h>
 #include <kernel/syscall.h>
+#include <kernel/uaccess.h>
+#include <kernel/errno.h>
 
-/* Exec system call implementation */
-int do_exec(const char* path, char* const argv[]) {
-    (void)argv;  /* Not implemented yet */
+/* Put back the caller's address space after a failed exec */
+static void exec_restore(process_t* proc, page_directory_t* old_dir,
+                         vma_t* old_vmas, uint32_t old_heap_start,
+                         uint32_t old_heap_end) {
+    page_directory_t* new_dir = proc->page_dir;
 
-    process_t* current = process_get_current();
-    if (current == 0) {
+    vma_free_all(proc);
+    proc->vmas = old_vmas;
+    proc->heap_start = old_heap_start;
+    proc->heap_end = old_heap_end;
+    proc->page_dir = old_dir;
+    vmm_destroy_page_directory(new_dir);
+}
+
+/* Size of the ELF image at a user address: the end of its header, its
+   program header table or its furthest segment file data, whichever is
+   last. Returns 0, -1 or -EFAULT. */
+static int exec_image_size(const char* path, uint32_t* size_out) {
+    elf32_header_t header;
+    if (copy_from_user(&header, path, sizeof(header)) != 0) {
+        vga_print("[-] exec: Bad program address\n");
+        return -EFAULT;
+    }
+
+    if (elf_check_header(&header) != 0) {
+        vga_print("[-] exec: Not a valid ELF binary\n");
         return -1;
     }
 
-    vga_print("[+] exec() called: ");
-    if (path != 0) {
-        vga_print(path);
-    } else {
-        vga_print("(null)");
+    if (header.e_phentsize < sizeof(elf32_phdr_t)) {
+        vga_print("[-] exec: Bad program header size\n");
+        return -1;
     }
-    vga_print("\n");
 
+    uint32_t table_size = (uint32_t)header.e_phnum * header.e_phentsize;
+    if (header.e_phoff > USER_SPACE_END - table_size) {
+        vga_print("[-] exec: Program headers out of range\n");
+        return -1;
+    }
+
+    uint32_t size = header.e_phoff + table_size;
+    if (size < sizeof(header)) {
+        size = sizeof(header);
+    }
+
+    for (uint32_t i = 0; i < header.e_phnum; i++) {
+        elf32_phdr_t phdr;
+        const char* src = path + header.e_phoff + i * header.e_phentsize;
+        if (copy_from_user(&phdr, src, sizeof(phdr)) != 0) {
+            vga_print("[-] exec: Bad program address\n");
+            return -EFAULT;
+        }
+
+        if (phdr.p_type != PT_LOAD) {
+            continue;
+        }
+        if (phdr.p_offset > USER_SPACE_END - phdr.p_filesz) {
+            vga_print("[-] exec: Segment out of range\n");
+            return -1;
+        }
+        if (phdr.p_offset + phdr.p_filesz > size) {
+            size = phdr.p_offset + phdr.p_filesz;
+        }
+    }
+
+    *size_out = size;
+    return 0;
+}
+
+/* Copy a program in from user memory and open its image. Returns 0, -1
+   or -EFAULT. */
+static int exec_open_image(const char* path, image_t** image_out) {
     /* For now, assume path is actually a pointer to ELF data in memory */
     /* In a real system, we would read from filesystem */
     if (path == 0) {
@@ -41,19 +99,65 @@ int do_exec(const char* path, char* const argv[]) {
         return -1;
     }
 
-    /* Check if it's an ELF binary */
-    elf32_header_t* header = (elf32_header_t*)path;
-    if (elf_check_header(header) != 0) {
+    /* Copy the image into the kernel before looking at it; the headers
+       say how much of it there is */
+    uint32_t elf_size;
+    int status = exec_image_size(path, &elf_size);
+    if (status != 0) {
+        return status;
+    }
+
+    uint8_t* data = (uint8_t*)kmalloc(elf_size);
+    if (data == 0) {
+        vga_print("[-] exec: Failed to allocate image buffer\n");
+        return -1;
+    }
+    if (copy_from_user(data, path, elf_size) != 0) {
+        vga_print("[-] exec: Bad program address\n");
+        kfree(data);
+        return -EFAULT;
+    }
+
+    /* Check the copy: user memory may have changed since it was sized */
+    if (elf_check_header((elf32_header_t*)data) != 0) {
         vga_print("[-] exec: Not a valid ELF binary\n");
+        kfree(data);
         return -1;
     }
 
+    /* The program's regions are filled from this copy on demand, so it
+       stays around for as long as they do. A program that is already
+       running shares its image, and with it the pages already filled. */
+    *image_out = image_open(data, elf_size);
+    return (*image_out != 0) ? 0 : -1;
+}
+
+/* Exec system call implementation */
+int do_exec(const char* path, char* const argv[]) {
+    (void)argv;  /* Not implemented yet */
+
+    process_t* current = process_get_current();
+    if (current == 0) {
+        return -1;
+    }
+
+    vga_print("[+] exec() called: 0x");
+    vga_print_hex((uint32_t)path);
+    vga_print("\n");
+
     /* For kernel processes, load directly */
     if (current->flags & PROC_FLAG_KERNEL) {
         vga_print("[-] exec: Cannot exec kernel processes\n");
         return -1;
     }
 
+    image_t* exec_image;
+    int status = exec_open_image(path, &exec_image);
+    if (status != 0) {
+        return status;
+    }
+    uint32_t entry_point = ((elf32_header_t*)exec_image->data)->e_entry;
+
     /* Save old page directory */
     page_directory_t* old_dir = current->page_dir;
 
@@ -61,39 +165,51 @@ int do_exec(const char* path, char* const argv[]) {
     page_directory_t* new_dir = vmm_create_page_directory();
     if (new_dir == 0) {
         vga_print("[-] exec: Failed to create new page directory\n");
+        image_put(exec_image);
         return -1;
     }
 
-    /* Switch to new page directory */
-    vmm_switch_page_directory(new_dir);
+    /* Load ELF binary into the new directory; it is filled in through
+       the VMM's foreign slot, so there is no need to switch to it. The
+       new program starts with its own set of regions. */
+    vma_t* old_vmas = current->vmas;
+    uint32_t old_heap_start = current->heap_start;
+    uint32_t old_heap_end = current->heap_end;
+    current->vmas = 0;
+    current->page_dir = new_dir;
 
-    /* Load ELF binary into process */
-    uint32_t elf_size = 4096;  /* Assume maximum of 4KB for test */
-    if (elf_load_to_process((uint8_t*)path, elf_size, current) != 0) {
+    int loaded = elf_load_to_process(exec_image, current);
+    image_put(exec_image);
+    if (loaded != 0) {
         vga_print("[-] exec: Failed to load ELF binary\n");
-        vmm_switch_page_directory(old_dir);
-        vmm_destroy_page_directory(new_dir);
+        exec_restore(current, old_dir, old_vmas, old_heap_start,
+                     old_heap_end);
         return -1;
     }
 
-    /* Allocate user stack */
-    uint32_t stack_phys = pmm_alloc_frame();
-    if (stack_phys == 0) {
-        vga_print("[-] exec: Failed to allocate stack\n");
-        vmm_switch_page_directory(old_dir);
-        vmm_destroy_page_directory(new_dir);
+    /* Reserve the user stack; its pages are filled in on first touch */
+    if (vma_add(current, USER_STACK_TOP - USER_STACK_SIZE, USER_STACK_TOP,
+                VMA_READ | VMA_WRITE | VMA_STACK) != 0) {
+        vga_print("[-] exec: Failed to reserve stack\n");
+        exec_restore(current, old_dir, old_vmas, old_heap_start,
+                     old_heap_end);
         return -1;
     }
 
-    uint32_t stack_virt = 0x7FFFF000;
-    vmm_map_page(stack_virt, stack_phys,
-                 PAGE_PRESENT | PAGE_WRITE | PAGE_USER);
+    current->stack_start = USER_STACK_TOP - USER_STACK_SIZE;
+    current->stack_end = USER_STACK_TOP;
+
+    /* Commit: run on the new directory, then tear down the old program's
+       regions and address space */
+    vmm_switch_page_directory(new_dir);
 
-    current->stack_start = stack_virt - USER_STACK_SIZE;
-    current->stack_end = stack_virt;
+    vma_t* new_vmas = current->vmas;
+    current->vmas = old_vmas;
+    vma_free_all(current);
+    current->vmas = new_vmas;
+    vmm_destroy_page_directory(old_dir);
 
-    /* Get entry point from ELF header */
-    uint32_t entry_point = header->e_entry;
+    /* Entry point from the ELF header */
     vga_print("[+] exec: Entry point at 0x");
     vga_print_hex(entry_point);
     vga_print("\n");
@@ -112,17 +228,53 @@ int do_exec(const char* path, char* const argv[]) {
     current->esi = 0;
     current->edi = 0;
 
-    /* Update page directory */
-    current->page_dir = new_dir;
-
-    /* Destroy old page directory (in a real system, we'd free the pages too) */
-    /* For now, just switch back and clean up later */
-    vmm_switch_page_directory(old_dir);
-
-    /* Free the old directory structure */
-    /* Note: In a real system, we'd need to free all the physical pages */
-
     vga_print("[+] exec: Successfully loaded program\n");
     return 0;
 }
 
+/* Spawn system call implementation */
+pid_t do_spawn(const char* path, char* const argv[]) {
+    (void)argv;  /* Not implemented yet */
+
+    process_t* current = process_get_current();
+    if (current == 0) {
+        return -1;
+    }
+
+    image_t* spawn_image;
+    int status = exec_open_image(path, &spawn_image);
+    if (status != 0) {
+        return status;
+    }
+
+    /* The child starts from an empty address space with its stack
+       reserved; unlike fork followed by exec, nothing of the parent's is
+       cloned only to be thrown away */
+    process_t* child = process_create(current->name, 0, 0);
+    if (child == 0) {
+        vga_print("[-] spawn: Failed to create process\n");
+        image_put(spawn_image);
+        return -1;
+    }
+
+    int loaded = elf_load_to_process(spawn_image, child);
+    image_put(spawn_image);
+    if (loaded != 0) {
+        vga_print("[-] spawn: Failed to load ELF binary\n");
+        vmm_destroy_page_directory(child->page_dir);
+        process_destroy(child);
+        return -1;
+    }
+
+    /* The scheduler resumes the child from a frame on its kernel stack,
+       which returns to user mode at the program's entry point */
+    if (process_init_user_stack(child, child->eip) != 0) {
+        vga_print("[-] spawn: Failed to allocate kernel stack\n");
+        vmm_destroy_page_directory(child->page_dir);
+        process_destroy(child);
+        return -1;
+    }
+
+    process_ready(child);
+    return child->pid;
+}
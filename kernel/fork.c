@@ -5,7 +5,6 @@
 #include <kernel/process.h>
 #include <kernel/vmm.h>
 #include <kernel/pmm.h>
-#include <kernel/heap.h>
 #include <kernel/vga.h>
 #include <kernel/string.h>
 #include <kernel/scheduler.h>
@@ -24,7 +23,7 @@ pid_t do_fork(void) {
     vga_print(")\n");
 
     /* Allocate new PCB for child */
-    process_t* child = (process_t*)kmalloc(sizeof(process_t));
+    process_t* child = process_alloc();
     if (child == 0) {
         vga_print("[-] fork: Failed to allocate child PCB\n");
         return -1;
@@ -40,32 +39,30 @@ pid_t do_fork(void) {
     child->exit_code = 0;
     child->priority = current->priority;
     child->quantum = current->quantum;
+    child->vmas = 0;
+    child->kernel_stack = 0;
 
     /* Clone page directory with COW */
     child->page_dir = vmm_clone_page_directory(current->page_dir);
     if (child->page_dir == 0) {
         vga_print("[-] fork: Failed to clone page directory\n");
-        kfree(child);
+        process_free(child);
         return -1;
     }
 
-    /* For user processes, allocate new stack */
+    /* User processes keep the parent's regions; the stack pages touched
+       so far are shared copy-on-write by the clone, the rest stay
+       demand-filled */
     if (!(child->flags & PROC_FLAG_KERNEL)) {
-        uint32_t stack_phys = pmm_alloc_frame();
-        if (stack_phys == 0) {
-            vga_print("[-] fork: Failed to allocate child stack\n");
-            kfree(child);
+        if (vma_copy(child, current) != 0) {
+            vga_print("[-] fork: Failed to copy memory regions\n");
+            vmm_destroy_page_directory(child->page_dir);
+            process_free(child);
             return -1;
         }
 
-        uint32_t stack_virt = 0x7FFFF000;
-        vmm_switch_page_directory(child->page_dir);
-        vmm_map_page(stack_virt, stack_phys,
-                     PAGE_PRESENT | PAGE_WRITE | PAGE_USER);
-        vmm_switch_page_directory(current->page_dir);
-
-        child->stack_start = stack_virt - USER_STACK_SIZE;
-        child->stack_end = stack_virt;
+        child->stack_start = current->stack_start;
+        child->stack_end = current->stack_end;
     } else {
         /* Kernel threads share stack initially */
         child->stack_start = current->stack_start;
@@ -78,6 +75,18 @@ pid_t do_fork(void) {
     child->esp = current->esp;
     child->ebp = current->ebp;
 
+    /* A user child enters the kernel on a stack of its own and resumes
+       from its copy of the parent's trap frame; kernel threads keep
+       running on the stack they share */
+    if (!(child->flags & PROC_FLAG_KERNEL) &&
+        (process_fork_user_stack(child, current) != 0)) {
+        vga_print("[-] fork: Failed to set up child kernel stack\n");
+        vma_free_all(child);
+        vmm_destroy_page_directory(child->page_dir);
+        process_free(child);
+        return -1;
+    }
+
     /* Copy registers */
     child->eax = 0;  /* Child returns 0 from fork */
     child->ebx = current->ebx;
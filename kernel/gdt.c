@@ -23,9 +23,21 @@ typedef struct {
     unsigned int base;
 } __attribute__((packed)) gdt_ptr_t;
 
+/* Task state segment. Only the ring 0 stack is used: the CPU switches to
+   ss0:esp0 when an interrupt arrives in user mode. */
+typedef struct {
+    unsigned int prev_tss;
+    unsigned int esp0;
+    unsigned int ss0;
+    unsigned int unused[22];
+    unsigned short trap;
+    unsigned short iomap_base;
+} __attribute__((packed)) tss_t;
+
 /* GDT entries */
-static gdt_entry_t gdt[5];
+static gdt_entry_t gdt[6];
 static gdt_ptr_t gdt_ptr;
+static tss_t tss;
 
 /* Function to set a GDT entry */
 static void gdt_set_entry(int num, unsigned int base, unsigned int limit,
@@ -49,11 +61,11 @@ static void gdt_set_entry(int num, unsigned int base, unsigned int limit,
 /* Initialize GDT */
 void gdt_init(void) {
     /* Setup GDT pointer */
-    gdt_ptr.limit = (sizeof(gdt_entry_t) * 5) - 1;
+    gdt_ptr.limit = (sizeof(gdt_entry_t) * 6) - 1;
     gdt_ptr.base = (unsigned int)&gdt;
 
     /* Clear GDT */
-    for (int i = 0; i < 5; i++) {
+    for (int i = 0; i < 6; i++) {
         gdt_set_entry(i, 0, 0, 0, 0);
     }
 
@@ -63,6 +75,7 @@ void gdt_init(void) {
      * 2: Kernel Data segment (base=0, limit=4GB, type=data, ring=0)
      * 3: User Code segment (base=0, limit=4GB, type=code, ring=3)
      * 4: User Data segment (base=0, limit=4GB, type=data, ring=3)
+     * 5: TSS (32-bit available TSS, ring=0)
      */
 
     /* Kernel Code Segment */
@@ -77,6 +90,15 @@ void gdt_init(void) {
     /* User Data Segment */
     gdt_set_entry(4, 0, 0xFFFFFFFF, 0xF2, 0xCF);
 
+    /* Task State Segment; no I/O permission bitmap */
+    unsigned char* tss_bytes = (unsigned char*)&tss;
+    for (unsigned int i = 0; i < sizeof(tss); i++) {
+        tss_bytes[i] = 0;
+    }
+    tss.ss0 = GDT_KERNEL_DATA;
+    tss.iomap_base = sizeof(tss);
+    gdt_set_entry(5, (unsigned int)&tss, sizeof(tss) - 1, 0x89, 0x00);
+
     /* Load GDT and reload segment registers */
     __asm__ __volatile__(
         "cli\n"                          /* Disable interrupts */
@@ -91,7 +113,15 @@ void gdt_init(void) {
         "pushl $1f\n"                   /* Push return address */
         "lretl\n"                       /* Far return to reload CS */
         "1:\n"
-        : : "m"(gdt_ptr), "i"(GDT_KERNEL_DATA), "i"(GDT_KERNEL_CODE)
+        "movw %3, %%ax\n"               /* Load task register */
+        "ltr %%ax\n"
+        : : "m"(gdt_ptr), "i"(GDT_KERNEL_DATA), "i"(GDT_KERNEL_CODE),
+            "i"(GDT_TSS)
         : "ax", "memory"
     );
 }
+
+/* Set the stack used for interrupts taken in user mode */
+void gdt_set_kernel_stack(unsigned int esp0) {
+    tss.esp0 = esp0;
+}
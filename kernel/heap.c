@@ -6,171 +6,425 @@
 #include <kernel/pmm.h>
 #include <kernel/vga.h>
 #include <kernel/string.h>
+#include <kernel/serial.h>
+
+/* Heap layout: blocks carry a boundary tag at both ends, so physical
+   neighbours are found by address arithmetic.
+
+     start                                                     end
+     | pad | prologue tag | block | block | ... | epilogue header |
+
+   The prologue tag and the epilogue header are size 0 and marked used,
+   so merging stops at either end of the heap. Blocks start HEAP_ALIGN -
+   HEAP_HEADER_SIZE bytes into an alignment unit, which keeps every
+   payload HEAP_ALIGN aligned. */
+
+#define HEAP_TAG_SIZE ((uint32_t)sizeof(uint32_t))
+#define HEAP_HEADER_SIZE ((uint32_t)sizeof(heap_block_t))
+#define HEAP_OVERHEAD (HEAP_HEADER_SIZE + HEAP_TAG_SIZE)
 
 /* Heap start and size */
 static void* heap_start;
-static uint32_t heap_size;
-static heap_block_t* heap_head;
+static uint32_t heap_size;          /* Bytes currently mapped */
+static uint32_t heap_initial_size;  /* Boot mapping, never trimmed */
+static uint32_t heap_peak_size;     /* High-water mark of heap_size */
 
-/* Statistics */
+/* Statistics: heap_free counts whole free blocks, heap_used the rest */
 static uint32_t heap_used;
 static uint32_t heap_free;
 
+/* Segregated free lists: class i holds free blocks whose size lies in
+   [2^(i + HEAP_MIN_SHIFT), 2^(i + HEAP_MIN_SHIFT + 1)) */
+#define HEAP_MIN_SHIFT 4
+#define HEAP_NUM_CLASSES (32 - HEAP_MIN_SHIFT)
+
+static heap_block_t* free_lists[HEAP_NUM_CLASSES];
+static uint32_t free_class_map;  /* Bit i set if free_lists[i] is non-empty */
+
+/* Free-list links, kept in the payload of free blocks */
+typedef struct {
+    heap_block_t* next_free;
+    heap_block_t* prev_free;
+} heap_free_links_t;
+
+/* Trimming hysteresis: the free tail must exceed trim_threshold bytes
+   before pages are unmapped, and trim_keep bytes stay mapped after */
+static uint32_t trim_threshold = HEAP_TRIM_THRESHOLD;
+static uint32_t trim_keep = HEAP_TRIM_KEEP;
+
+#ifdef HEAP_PROFILE
+/* Call-site table (open addressing on the return address); slot
+   HEAP_PROFILE_SITES collects sites that did not fit */
+static heap_site_stats_t profile_sites[HEAP_PROFILE_SITES + 1];
+#endif
+
 /* Align size to alignment boundary */
 static inline uint32_t align_size(uint32_t size, uint32_t alignment) {
     return (size + alignment - 1) & ~(alignment - 1);
 }
 
-/* Find free block */
-static heap_block_t* find_free_block(uint32_t size) {
-    heap_block_t* block = heap_head;
-    uint32_t needed = align_size(size, HEAP_ALIGN);
+/* Smallest block: tags plus the free-list links */
+#define HEAP_MIN_BLOCK \
+    align_size(HEAP_OVERHEAD + (uint32_t)sizeof(heap_free_links_t), HEAP_ALIGN)
+
+static inline uint32_t block_size(const heap_block_t* block) {
+    return block->tag & ~HEAP_TAG_USED;
+}
+
+static inline int block_is_free(const heap_block_t* block) {
+    return (block->tag & HEAP_TAG_USED) == 0U;
+}
+
+static inline uint32_t* block_footer(heap_block_t* block) {
+    return (uint32_t*)((uint8_t*)block + block_size(block) - HEAP_TAG_SIZE);
+}
+
+/* Write both boundary tags of a block */
+static inline void block_set(heap_block_t* block, uint32_t size,
+                             uint32_t used) {
+    block->tag = size | used;
+#ifdef HEAP_DEBUG
+    block->magic = HEAP_MAGIC;
+#endif
+    *block_footer(block) = block->tag;
+}
+
+static inline heap_block_t* block_next(heap_block_t* block) {
+    return (heap_block_t*)((uint8_t*)block + block_size(block));
+}
+
+/* Tag of the block before this one (the prologue tag for the first) */
+static inline uint32_t block_prev_tag(heap_block_t* block) {
+    return *(uint32_t*)((uint8_t*)block - HEAP_TAG_SIZE);
+}
+
+static inline heap_block_t* block_prev(heap_block_t* block) {
+    return (heap_block_t*)((uint8_t*)block -
+                           (block_prev_tag(block) & ~HEAP_TAG_USED));
+}
+
+static inline void* block_data(heap_block_t* block) {
+    return (uint8_t*)block + HEAP_HEADER_SIZE;
+}
+
+static inline heap_block_t* data_block(void* ptr) {
+    return (heap_block_t*)((uint8_t*)ptr - HEAP_HEADER_SIZE);
+}
+
+/* The epilogue header sits in the last bytes of the mapped heap */
+static inline heap_block_t* heap_epilogue(void) {
+    return (heap_block_t*)((uint8_t*)heap_start + heap_size -
+                           HEAP_HEADER_SIZE);
+}
+
+static inline void set_epilogue(void) {
+    heap_block_t* epilogue = heap_epilogue();
+    epilogue->tag = HEAP_TAG_USED;
+#ifdef HEAP_DEBUG
+    epilogue->magic = HEAP_MAGIC;
+#endif
+}
+
+static inline heap_free_links_t* free_links(heap_block_t* block) {
+    return (heap_free_links_t*)block_data(block);
+}
+
+/* Size class holding blocks of this size (floor of log2) */
+static inline uint32_t size_class(uint32_t size) {
+    uint32_t bit = 31U - (uint32_t)__builtin_clz(size);
+    return (bit < HEAP_MIN_SHIFT) ? 0U : bit - HEAP_MIN_SHIFT;
+}
+
+/* Block size (tags included) actually reserved for a request */
+static inline uint32_t block_size_for(uint32_t size) {
+    uint32_t needed = align_size(size + HEAP_OVERHEAD, HEAP_ALIGN);
+    return (needed < HEAP_MIN_BLOCK) ? HEAP_MIN_BLOCK : needed;
+}
+
+/* Add a free block to the list for its size class */
+static void free_list_insert(heap_block_t* block) {
+    uint32_t cls = size_class(block_size(block));
+    heap_free_links_t* links = free_links(block);
+
+    links->prev_free = 0;
+    links->next_free = free_lists[cls];
+    if (free_lists[cls] != 0) {
+        free_links(free_lists[cls])->prev_free = block;
+    }
+
+    free_lists[cls] = block;
+    free_class_map |= (1U << cls);
+}
+
+/* Remove a free block from its size class list (before its size changes) */
+static void free_list_remove(heap_block_t* block) {
+    uint32_t cls = size_class(block_size(block));
+    heap_free_links_t* links = free_links(block);
+
+    if (links->prev_free != 0) {
+        free_links(links->prev_free)->next_free = links->next_free;
+    } else {
+        free_lists[cls] = links->next_free;
+    }
+    if (links->next_free != 0) {
+        free_links(links->next_free)->prev_free = links->prev_free;
+    }
+
+    if (free_lists[cls] == 0) {
+        free_class_map &= ~(1U << cls);
+    }
+}
+
+/* Find a free block of at least `needed` bytes */
+static heap_block_t* find_free_block(uint32_t needed) {
+    /* Any block in a class whose lower bound is >= needed fits, so take
+       the head of the first non-empty one */
+    uint32_t cls = size_class(needed);
+    uint32_t fit_cls = cls;
+    if ((needed & (needed - 1U)) != 0U) {
+        fit_cls++;
+    }
+
+    if (fit_cls < HEAP_NUM_CLASSES) {
+        uint32_t candidates = free_class_map & ~((1U << fit_cls) - 1U);
+        if (candidates != 0U) {
+            return free_lists[__builtin_ctz(candidates)];
+        }
+    }
 
-    while (block != 0) {
-        if (block->is_free && block->size >= needed) {
+    /* Otherwise only blocks in needed's own class might fit */
+    for (heap_block_t* block = free_lists[cls]; block != 0;
+         block = free_links(block)->next_free) {
+        if (block_size(block) >= needed) {
             return block;
         }
-        block = block->next;
     }
 
     return 0;
 }
 
-/* Split block if needed */
-static void split_block(heap_block_t* block, uint32_t size) {
-    uint32_t aligned_size = align_size(size, HEAP_ALIGN);
-    uint32_t total_size = align_size(size + sizeof(heap_block_t), HEAP_ALIGN);
+/* Merge a free block (not on any list) with free neighbours and list
+   the result */
+static void merge_blocks(heap_block_t* block) {
+    uint32_t size = block_size(block);
 
-    if (block->size - total_size >= sizeof(heap_block_t) + HEAP_ALIGN) {
-        /* Create new block */
-        heap_block_t* new_block = (heap_block_t*)((uint8_t*)block + total_size);
-        new_block->size = block->size - total_size;
-        new_block->magic = HEAP_MAGIC;
-        new_block->is_free = 1;
-        new_block->prev = block;
-        new_block->next = block->next;
+    /* Merge with next block if free */
+    heap_block_t* next = block_next(block);
+    if (block_is_free(next)) {
+        free_list_remove(next);
+        size += block_size(next);
+    }
 
-        if (block->next != 0) {
-            block->next->prev = new_block;
-        }
+    /* Merge with previous block if free */
+    if ((block_prev_tag(block) & HEAP_TAG_USED) == 0U) {
+        heap_block_t* prev = block_prev(block);
+        free_list_remove(prev);
+        size += block_size(prev);
+        block = prev;
+    }
 
-        block->next = new_block;
-        block->size = aligned_size;
+    block_set(block, size, 0);
+    free_list_insert(block);
+}
 
-        heap_free += new_block->size;
+/* Split a used block so it is `needed` bytes, returning the remainder
+   to the free lists */
+static void split_block(heap_block_t* block, uint32_t needed) {
+    uint32_t remaining = block_size(block) - needed;
+    if (remaining < HEAP_MIN_BLOCK) {
+        return;
     }
+
+    block_set(block, needed, HEAP_TAG_USED);
+
+    heap_block_t* new_block = block_next(block);
+    block_set(new_block, remaining, 0);
+
+    heap_used -= remaining;
+    heap_free += remaining;
+
+    /* The remainder may border a free block when a used block shrinks */
+    merge_blocks(new_block);
 }
 
-/* Merge adjacent free blocks */
-static void merge_blocks(heap_block_t* block) {
-    /* Merge with next block if free */
-    if (block->next != 0 && block->next->is_free) {
-        heap_block_t* next = block->next;
+/* Map more pages at the end of the heap, enough for a `needed` byte block */
+static int expand_heap(uint32_t needed) {
+    uint32_t expand_size = align_size(needed, PAGE_SIZE);
+
+    uint32_t start_addr = (uint32_t)heap_start + heap_size;
+    uint32_t end_addr = start_addr + expand_size;
+
+    /* Map new pages, allocating frames a batch at a time. The heap is
+       shared by all address spaces, so its pages are global. */
+    uint32_t frames[PMM_BULK_BATCH];
+    uint32_t addr = start_addr;
+    while (addr < end_addr) {
+        uint32_t batch = (end_addr - addr) / PAGE_SIZE;
+        if (batch > PMM_BULK_BATCH) {
+            batch = PMM_BULK_BATCH;
+        }
 
-        block->size += next->size + sizeof(heap_block_t);
-        block->next = next->next;
+        if (pmm_alloc_frames_bulk(frames, batch) != 0) {
+            vga_print("[-] Error: Out of memory during heap expand!\n");
 
-        if (next->next != 0) {
-            next->next->prev = block;
+            /* Roll back any pages mapped in this expansion. */
+            vmm_unmap_range(start_addr, (addr - start_addr) / PAGE_SIZE);
+
+            return -1;
         }
 
-        heap_used -= sizeof(heap_block_t);
-        heap_free += sizeof(heap_block_t);
+        vmm_map_range(addr, frames, batch,
+                      PAGE_PRESENT | PAGE_WRITE | PAGE_GLOBAL);
+        addr += batch * PAGE_SIZE;
     }
 
-    /* Merge with previous block if free */
-    if (block->prev != 0 && block->prev->is_free) {
-        heap_block_t* prev = block->prev;
+    /* The old epilogue becomes the header of the new block */
+    heap_block_t* new_block = heap_epilogue();
+    heap_size += expand_size;
+    if (heap_size > heap_peak_size) {
+        heap_peak_size = heap_size;
+    }
+
+    block_set(new_block, expand_size, 0);
+    set_epilogue();
+    heap_free += expand_size;
+
+    merge_blocks(new_block);
+    return 0;
+}
+
+/* Unmap whole free pages at the end of the heap, giving their frames
+   back to the PMM */
+static void heap_trim(void) {
+    heap_block_t* epilogue = heap_epilogue();
+    if ((block_prev_tag(epilogue) & HEAP_TAG_USED) != 0U) {
+        return;
+    }
 
-        prev->size += block->size + sizeof(heap_block_t);
-        prev->next = block->next;
+    heap_block_t* tail = block_prev(epilogue);
+    if (block_size(tail) <= trim_threshold) {
+        return;
+    }
 
-        if (block->next != 0) {
-            block->next->prev = prev;
+    /* Keep a minimal tail block, trim_keep bytes and the boot mapping */
+    uint32_t heap_end = (uint32_t)heap_start + heap_size;
+    uint32_t keep_end = align_size((uint32_t)tail + HEAP_MIN_BLOCK +
+                                   trim_keep + HEAP_HEADER_SIZE, PAGE_SIZE);
+    uint32_t initial_end = (uint32_t)heap_start + heap_initial_size;
+    if (keep_end < initial_end) {
+        keep_end = initial_end;
+    }
+    if (keep_end >= heap_end) {
+        return;
+    }
+
+    uint32_t release = heap_end - keep_end;
+
+    free_list_remove(tail);
+    heap_size -= release;
+    heap_free -= release;
+    block_set(tail, block_size(tail) - release, 0);
+    set_epilogue();
+    free_list_insert(tail);
+
+    vmm_unmap_range(keep_end, release / PAGE_SIZE);
+}
+
+#ifdef HEAP_PROFILE
+/* Slot of a call site, claiming a free one on first use */
+static uint32_t profile_slot(uint32_t site) {
+    uint32_t slot = (site * 2654435761U) >> 25;  /* 128 slots */
+
+    for (uint32_t n = 0; n < HEAP_PROFILE_SITES; n++) {
+        if (profile_sites[slot].site == site) {
+            return slot;
         }
+        if (profile_sites[slot].site == 0U) {
+            profile_sites[slot].site = site;
+            return slot;
+        }
+        slot = (slot + 1U) & (HEAP_PROFILE_SITES - 1U);
+    }
 
-        heap_used -= sizeof(heap_block_t);
-        heap_free += sizeof(heap_block_t);
+    return HEAP_PROFILE_SITES;
+}
+
+/* Account a block size change for the site that owns the block */
+static void profile_adjust(heap_block_t* block, uint32_t old_size) {
+    heap_site_stats_t* stats = &profile_sites[block->site_slot];
+
+    stats->live_bytes += block_size(block);
+    stats->live_bytes -= old_size;
+    if (stats->live_bytes > stats->peak_bytes) {
+        stats->peak_bytes = stats->live_bytes;
     }
 }
 
+static void profile_alloc(heap_block_t* block, uint32_t site) {
+    block->site_slot = profile_slot(site);
+    profile_sites[block->site_slot].allocs++;
+    profile_sites[block->site_slot].live_count++;
+    profile_adjust(block, 0);
+}
+
+static void profile_free(heap_block_t* block) {
+    heap_site_stats_t* stats = &profile_sites[block->site_slot];
+
+    stats->live_count--;
+    stats->live_bytes -= block_size(block);
+}
+#endif
+
 /* Initialize kernel heap */
 void heap_init(void* start, uint32_t size) {
     vga_print("[+] Initializing Kernel Heap...\n");
 
     heap_start = start;
     heap_size = size;
-    heap_used = sizeof(heap_block_t);
-    heap_free = size - sizeof(heap_block_t);
+    heap_initial_size = size;
+    heap_peak_size = size;
+
+    for (uint32_t i = 0; i < HEAP_NUM_CLASSES; i++) {
+        free_lists[i] = 0;
+    }
+    free_class_map = 0;
+
+    /* Create initial block between the prologue tag and the epilogue */
+    heap_block_t* first =
+        (heap_block_t*)((uint8_t*)start + HEAP_ALIGN - HEAP_HEADER_SIZE);
+    *(uint32_t*)((uint8_t*)first - HEAP_TAG_SIZE) = HEAP_TAG_USED;
+    block_set(first, size - HEAP_ALIGN, 0);
+    set_epilogue();
+
+    heap_used = HEAP_ALIGN;
+    heap_free = size - HEAP_ALIGN;
 
-    /* Create initial block */
-    heap_head = (heap_block_t*)start;
-    heap_head->size = size - sizeof(heap_block_t);
-    heap_head->magic = HEAP_MAGIC;
-    heap_head->is_free = 1;
-    heap_head->next = 0;
-    heap_head->prev = 0;
+    free_list_insert(first);
 
     vga_print("    Heap size: ");
     vga_print_dec(size / 1024);
     vga_print(" KB\n");
 }
 
-/* Allocate memory */
-void* kmalloc(uint32_t size) {
+/* Allocate memory on behalf of a call site */
+static void* heap_alloc(uint32_t size, uint32_t site) {
+    (void)site;
+
     if (size == 0) {
         return 0;
     }
 
+    uint32_t needed = block_size_for(size);
+
     /* Find free block */
-    heap_block_t* block = find_free_block(size);
+    heap_block_t* block = find_free_block(needed);
 
     if (block == 0) {
-        /* Expand heap - map more pages */
-        uint32_t expand_size = align_size(size + sizeof(heap_block_t), PAGE_SIZE);
-        uint32_t new_heap_size = heap_used + heap_free + expand_size;
-
-        uint32_t start_addr = (uint32_t)heap_start + heap_used + heap_free;
-        uint32_t end_addr = (uint32_t)heap_start + new_heap_size;
-
-        /* Map new pages */
-        uint32_t addr;
-        for (addr = start_addr; addr < end_addr; addr += PAGE_SIZE) {
-            uint32_t phys = pmm_alloc_frame();
-            if (phys == 0) {
-                vga_print("[-] Error: Out of memory during heap expand!\n");
-
-                /* Roll back any pages mapped in this expansion. */
-                for (uint32_t rollback = start_addr; rollback < addr;
-                     rollback += PAGE_SIZE) {
-                    vmm_unmap_page(rollback);
-                }
-
-                return 0;
-            }
-            vmm_map_page(addr, phys, PAGE_PRESENT | PAGE_WRITE);
+        /* Expand heap - map more pages, then try again */
+        if (expand_heap(needed) != 0) {
+            return 0;
         }
-
-        /* Update heap block */
-        heap_block_t* last = heap_head;
-        while (last->next != 0) {
-            last = last->next;
-        }
-
-        heap_block_t* new_block =
-            (heap_block_t*)((uint8_t*)heap_start + heap_used + heap_free);
-        new_block->size = expand_size - sizeof(heap_block_t);
-        new_block->magic = HEAP_MAGIC;
-        new_block->is_free = 1;
-        new_block->next = 0;
-        new_block->prev = last;
-
-        last->next = new_block;
-
-        heap_free += new_block->size + sizeof(heap_block_t);
-
-        /* Try again */
-        block = find_free_block(size);
+        block = find_free_block(needed);
     }
 
     if (block == 0) {
@@ -178,15 +432,45 @@ void* kmalloc(uint32_t size) {
         return 0;
     }
 
-    /* Split block if needed */
-    split_block(block, size);
+    free_list_remove(block);
 
     /* Mark as used */
-    block->is_free = 0;
-    heap_used += block->size;
-    heap_free -= block->size;
+    block_set(block, block_size(block), HEAP_TAG_USED);
+    heap_used += block_size(block);
+    heap_free -= block_size(block);
+
+    /* Split block if needed */
+    split_block(block, needed);
+
+#ifdef HEAP_PROFILE
+    profile_alloc(block, site);
+#endif
+
+    return block_data(block);
+}
 
-    return (void*)((uint8_t*)block + sizeof(heap_block_t));
+/* Allocate memory */
+void* kmalloc(uint32_t size) {
+    return heap_alloc(size, (uint32_t)__builtin_return_address(0));
+}
+
+/* Check a pointer handed back to the heap */
+static int check_block(heap_block_t* block) {
+#ifdef HEAP_DEBUG
+    /* Check magic and that both tags agree */
+    if ((block->magic != HEAP_MAGIC) || (*block_footer(block) != block->tag)) {
+        vga_print("[-] Error: Invalid heap block!\n");
+        return -1;
+    }
+#endif
+
+    /* Check if already free */
+    if (block_is_free(block)) {
+        vga_print("[-] Warning: Double free detected!\n");
+        return -1;
+    }
+
+    return 0;
 }
 
 /* Free memory */
@@ -195,27 +479,38 @@ void kfree(void* ptr) {
         return;
     }
 
-    heap_block_t* block = (heap_block_t*)((uint8_t*)ptr - sizeof(heap_block_t));
-
-    /* Check magic */
-    if (block->magic != HEAP_MAGIC) {
-        vga_print("[-] Error: Invalid heap block!\n");
+    heap_block_t* block = data_block(ptr);
+    if (check_block(block) != 0) {
         return;
     }
 
-    /* Check if already free */
-    if (block->is_free) {
-        vga_print("[-] Warning: Double free detected!\n");
-        return;
-    }
+#ifdef HEAP_PROFILE
+    profile_free(block);
+#endif
 
     /* Mark as free */
-    block->is_free = 1;
-    heap_used -= block->size;
-    heap_free += block->size;
+    uint32_t size = block_size(block);
+    block_set(block, size, 0);
+    heap_used -= size;
+    heap_free += size;
 
     /* Merge with adjacent blocks */
     merge_blocks(block);
+
+    /* Release free pages at the end of the heap */
+    heap_trim();
+}
+
+/* Grow a used block in place by absorbing the free block after it */
+static void absorb_free_next(heap_block_t* block) {
+    heap_block_t* next = block_next(block);
+    uint32_t gained = block_size(next);
+
+    free_list_remove(next);
+    block_set(block, block_size(block) + gained, HEAP_TAG_USED);
+
+    heap_used += gained;
+    heap_free -= gained;
 }
 
 /* Reallocate memory */
@@ -229,26 +524,58 @@ void* krealloc(void* ptr, uint32_t size) {
         return 0;
     }
 
-    heap_block_t* block = (heap_block_t*)((uint8_t*)ptr - sizeof(heap_block_t));
-
-    /* Check magic */
-    if (block->magic != HEAP_MAGIC) {
+    heap_block_t* block = data_block(ptr);
+    if (check_block(block) != 0) {
         return 0;
     }
 
-    /* If new size fits in current block */
-    if (block->size >= size) {
+    uint32_t needed = block_size_for(size);
+    uint32_t old_size = block_size(block);
+
+    /* Shrink (or fit) in place, returning any spare tail */
+    if (old_size >= needed) {
+        split_block(block, needed);
+#ifdef HEAP_PROFILE
+        profile_adjust(block, old_size);
+#endif
+        heap_trim();
+        return ptr;
+    }
+
+    /* Space reachable in place: this block plus a free neighbour after it */
+    heap_block_t* next = block_next(block);
+    uint32_t available = block_size(block);
+    if (block_is_free(next)) {
+        available += block_size(next);
+    }
+
+    /* At the end of the heap, map more pages right behind the block */
+    heap_block_t* epilogue = heap_epilogue();
+    if (available < needed &&
+        (next == epilogue ||
+         (block_is_free(next) && block_next(next) == epilogue))) {
+        if (expand_heap(needed - available) == 0) {
+            available = block_size(block) + block_size(block_next(block));
+        }
+    }
+
+    if (available >= needed) {
+        absorb_free_next(block);
+        split_block(block, needed);
+#ifdef HEAP_PROFILE
+        profile_adjust(block, old_size);
+#endif
         return ptr;
     }
 
     /* Allocate new block */
-    void* new_ptr = kmalloc(size);
+    void* new_ptr = heap_alloc(size, (uint32_t)__builtin_return_address(0));
     if (new_ptr == 0) {
         return 0;
     }
 
     /* Copy data */
-    memcpy(new_ptr, ptr, block->size);
+    memcpy(new_ptr, ptr, old_size - HEAP_OVERHEAD);
 
     /* Free old block */
     kfree(ptr);
@@ -268,3 +595,102 @@ uint32_t heap_get_used_size(void) {
 uint32_t heap_get_free_size(void) {
     return heap_free;
 }
+
+uint32_t heap_get_mapped_size(void) {
+    return heap_size;
+}
+
+uint32_t heap_get_peak_size(void) {
+    return heap_peak_size;
+}
+
+/* Set trimming hysteresis */
+void heap_set_trim(uint32_t threshold, uint32_t keep) {
+    trim_threshold = threshold;
+    trim_keep = keep;
+}
+
+#ifdef HEAP_PROFILE
+/* Print the call sites holding the most heap memory */
+void heap_profile_print(uint32_t max_sites) {
+    uint8_t shown[HEAP_PROFILE_SITES + 1];
+    for (uint32_t i = 0; i <= HEAP_PROFILE_SITES; i++) {
+        shown[i] = 0;
+    }
+
+    vga_print("SITE        LIVE BYTES  LIVE  ALLOCS  PEAK BYTES\n");
+
+    /* Repeatedly pick the largest remaining site; the table is small */
+    for (uint32_t rank = 0; rank < max_sites; rank++) {
+        uint32_t best = HEAP_PROFILE_SITES + 1U;
+        for (uint32_t i = 0; i <= HEAP_PROFILE_SITES; i++) {
+            if (shown[i] || profile_sites[i].allocs == 0U) {
+                continue;
+            }
+            if (best > HEAP_PROFILE_SITES ||
+                profile_sites[i].live_bytes > profile_sites[best].live_bytes) {
+                best = i;
+            }
+        }
+        if (best > HEAP_PROFILE_SITES) {
+            break;
+        }
+        shown[best] = 1;
+
+        heap_site_stats_t* stats = &profile_sites[best];
+        if (best == HEAP_PROFILE_SITES) {
+            vga_print("other     ");
+        } else {
+            vga_print_hex(stats->site);
+        }
+        vga_print("  ");
+        vga_print_dec(stats->live_bytes);
+        vga_print("  ");
+        vga_print_dec(stats->live_count);
+        vga_print("  ");
+        vga_print_dec(stats->allocs);
+        vga_print("  ");
+        vga_print_dec(stats->peak_bytes);
+        vga_print("\n");
+    }
+}
+
+/* Write every tracked call site to the serial port */
+void heap_profile_dump_serial(void) {
+    serial_write("heap-profile begin\n");
+
+    for (uint32_t i = 0; i <= HEAP_PROFILE_SITES; i++) {
+        heap_site_stats_t* stats = &profile_sites[i];
+        if (stats->allocs == 0U) {
+            continue;
+        }
+
+        serial_write("site=");
+        if (i == HEAP_PROFILE_SITES) {
+            serial_write("other");
+        } else {
+            serial_write_hex(stats->site);
+        }
+        serial_write(" live_bytes=");
+        serial_write_dec(stats->live_bytes);
+        serial_write(" live=");
+        serial_write_dec(stats->live_count);
+        serial_write(" allocs=");
+        serial_write_dec(stats->allocs);
+        serial_write(" peak_bytes=");
+        serial_write_dec(stats->peak_bytes);
+        serial_write("\n");
+    }
+
+    serial_write("heap-profile end\n");
+}
+#else
+void heap_profile_print(uint32_t max_sites) {
+    (void)max_sites;
+    vga_print("Heap profiling is disabled (build with -DHEAP_PROFILE)\n");
+}
+
+void heap_profile_dump_serial(void) {
+    serial_write("heap-profile disabled\n");
+}
+#endif
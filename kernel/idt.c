@@ -110,7 +110,7 @@ registers_t* isr_handler(registers_t *regs) {
         /* Exception handling */
         switch (regs->int_no) {
             case 14: /* Page fault */
-                vmm_page_fault_handler(regs->err_code);
+                vmm_page_fault_handler(regs);
                 break;
 
             default:
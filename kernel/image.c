@@ -0,0 +1,191 @@
+/* SYNAPSE SO - Program Image Implementation */
+/* Licensed under GPLv3 */
+
+#include <kernel/image.h>
+#include <kernel/pmm.h>
+#include <kernel/vmm.h>
+#include <kernel/heap.h>
+#include <kernel/vga.h>
+#include <kernel/string.h>
+
+/* Open images, searched when a file is opened again */
+static image_t* image_list = 0;
+
+/* Page cache counters */
+static uint32_t cached_pages = 0;
+static uint32_t cache_hits = 0;
+static uint32_t cache_fills = 0;
+
+/* FNV-1a hash of a file's contents */
+static uint32_t image_hash(const uint8_t* data, uint32_t size) {
+    uint32_t hash = 2166136261U;
+    for (uint32_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+/* Open image with the same contents, with a reference taken */
+static image_t* image_find(const uint8_t* data, uint32_t size,
+                           uint32_t hash) {
+    for (image_t* image = image_list; image != 0; image = image->next) {
+        if ((image->hash == hash) && (image->size == size) &&
+            (memcmp(image->data, data, size) == 0)) {
+            image->refs++;
+            return image;
+        }
+    }
+    return 0;
+}
+
+/* Image for a kmalloc'd file copy */
+image_t* image_open(uint8_t* data, uint32_t size) {
+    if ((data == 0) || (size == 0U)) {
+        kfree(data);
+        return 0;
+    }
+
+    uint32_t hash = image_hash(data, size);
+
+    uint32_t irq = pmm_irq_save();
+    image_t* image = image_find(data, size, hash);
+    pmm_irq_restore(irq);
+
+    if (image != 0) {
+        kfree(data);
+        return image;
+    }
+
+    image = (image_t*)kmalloc(sizeof(image_t));
+    if (image == 0) {
+        vga_print("[-] image: Failed to allocate image\n");
+        kfree(data);
+        return 0;
+    }
+
+    image->pages = (size + PAGE_SIZE - 1U) / PAGE_SIZE;
+    image->frames = (uint32_t*)kmalloc(image->pages * sizeof(uint32_t));
+    if (image->frames == 0) {
+        vga_print("[-] image: Failed to allocate frame table\n");
+        kfree(image);
+        kfree(data);
+        return 0;
+    }
+    memset(image->frames, 0, image->pages * sizeof(uint32_t));
+
+    image->data = data;
+    image->size = size;
+    image->hash = hash;
+    image->refs = 1;
+
+    irq = pmm_irq_save();
+    image->next = image_list;
+    image_list = image;
+    pmm_irq_restore(irq);
+
+    return image;
+}
+
+/* Take a reference */
+void image_get(image_t* image) {
+    uint32_t irq = pmm_irq_save();
+    image->refs++;
+    pmm_irq_restore(irq);
+}
+
+/* Drop a reference, freeing the image with the last one */
+void image_put(image_t* image) {
+    if (image == 0) {
+        return;
+    }
+
+    uint32_t irq = pmm_irq_save();
+    if (--image->refs != 0U) {
+        pmm_irq_restore(irq);
+        return;
+    }
+
+    image_t** link = &image_list;
+    while (*link != 0) {
+        if (*link == image) {
+            *link = image->next;
+            break;
+        }
+        link = &(*link)->next;
+    }
+
+    /* Mappings of cached frames hold their own references */
+    for (uint32_t i = 0; i < image->pages; i++) {
+        if (image->frames[i] != 0U) {
+            pmm_free_frame(image->frames[i]);
+            cached_pages--;
+        }
+    }
+    pmm_irq_restore(irq);
+
+    kfree(image->frames);
+    kfree(image->data);
+    kfree(image);
+}
+
+/* Cached frame for a file page, filled on first use */
+uint32_t image_page_frame(image_t* image, uint32_t offset) {
+    uint32_t index = offset / PAGE_SIZE;
+    if (((offset & 0xFFFU) != 0U) || (index >= image->pages)) {
+        return 0;
+    }
+
+    uint32_t irq = pmm_irq_save();
+
+    uint32_t phys = image->frames[index];
+    if (phys != 0U) {
+        cache_hits++;
+    } else {
+        phys = pmm_alloc_frame();
+        uint32_t dest = (phys != 0U) ? vmm_kmap_atomic(phys) : 0U;
+        if (dest == 0U) {
+            if (phys != 0U) {
+                pmm_free_frame(phys);
+            }
+            pmm_irq_restore(irq);
+            vga_print("[-] image: Failed to fill page\n");
+            return 0;
+        }
+
+        /* The last page of the file is padded with zeroes */
+        uint32_t length = image->size - offset;
+        if (length > PAGE_SIZE) {
+            length = PAGE_SIZE;
+        }
+        memcpy((void*)dest, image->data + offset, length);
+        memset((uint8_t*)dest + length, 0, PAGE_SIZE - length);
+        vmm_kunmap_atomic(dest);
+
+        /* The cache keeps the allocation's reference */
+        image->frames[index] = phys;
+        cached_pages++;
+        cache_fills++;
+    }
+
+    pmm_ref_frame(phys);
+    pmm_irq_restore(irq);
+    return phys;
+}
+
+/* Get image and page cache statistics */
+void image_get_stats(image_stats_t* stats) {
+    if (stats == 0) {
+        return;
+    }
+
+    uint32_t irq = pmm_irq_save();
+    stats->images = 0;
+    for (image_t* image = image_list; image != 0; image = image->next) {
+        stats->images++;
+    }
+    stats->cached_pages = cached_pages;
+    stats->hits = cache_hits;
+    stats->fills = cache_fills;
+    pmm_irq_restore(irq);
+}
@@ -0,0 +1,25 @@
+/* SYNAPSE SO - Kernel Microbenchmarks */
+/* Licensed under GPLv3 */
+
+#ifndef KERNEL_BENCH_H
+#define KERNEL_BENCH_H
+
+#include <stdint.h>
+
+/* Kernel heap pages touched on each side of a switch */
+#define BENCH_TOUCH_PAGES 32
+
+/* Pages mapped in the parent directory that the clone has to cover */
+#define BENCH_CLONE_PAGES 256
+
+/* Measure the cost of switching address spaces (CR3 reload plus touching
+   kernel memory), with and without global kernel pages */
+void bench_context_switch(uint32_t iterations);
+
+/* Measure starting a program from a user process with BENCH_CLONE_PAGES
+   pages: do_fork followed by do_exec in the child, against do_spawn.
+   Both run in full (PCB, kernel stack, copy-in of the program, regions
+   and page directories), including the console output they print. */
+void bench_spawn(uint32_t iterations);
+
+#endif /* KERNEL_BENCH_H */
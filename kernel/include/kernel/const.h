@@ -4,9 +4,13 @@
 #ifndef KERNEL_CONST_H
 #define KERNEL_CONST_H
 
-/* Stack sizes */
+/* Stack sizes. User stacks are reserved up front and filled in on
+   demand, so only the pages a process touches cost memory. */
 #define KERNEL_STACK_SIZE 0x2000
-#define USER_STACK_SIZE   0x1000
+#define USER_STACK_SIZE   0x10000
+
+/* Top of the user stack (it grows down from here) */
+#define USER_STACK_TOP    0x7FFFF000U
 
 /* Process states */
 #define PROC_STATE_READY    0
@@ -76,4 +76,11 @@ void cpu_print_info(void);
 /* Enable CPU features (SSE, etc) */
 void cpu_enable_features(void);
 
+/* Read the time stamp counter (needs CPU_FEATURE_TSC) */
+static inline uint64_t cpu_rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
 #endif /* KERNEL_CPU_H */
@@ -6,8 +6,9 @@
 
 #include <stdint.h>
 
-/* Forward declaration */
+/* Forward declarations */
 typedef struct process process_t;
+struct image;
 
 /* ELF identification */
 #define EI_NIDENT 16
@@ -115,7 +116,9 @@ typedef struct {
 
 /* ELF loader functions */
 int elf_check_header(elf32_header_t* header);
-int elf_load(uint8_t* elf_data, uint32_t size, uint32_t* entry_point);
-int elf_load_to_process(uint8_t* elf_data, uint32_t size, process_t* proc);
+
+/* Register the PT_LOAD segments of an image as regions of a process; the
+   regions take references to the image and are filled on demand */
+int elf_load_to_process(struct image* image, process_t* proc);
 
 #endif /* KERNEL_ELF_H */
@@ -0,0 +1,10 @@
+/* SYNAPSE SO - Kernel Error Numbers */
+/* Licensed under GPLv3 */
+
+#ifndef KERNEL_ERRNO_H
+#define KERNEL_ERRNO_H
+
+/* Returned negated (-EFAULT) by system calls; values follow Linux */
+#define EFAULT 14  /* Bad address */
+
+#endif /* KERNEL_ERRNO_H */
@@ -7,8 +7,14 @@
 #include <stdint.h>
 #include <kernel/const.h>
 #include <kernel/vmm.h>
+#include <kernel/process.h>
 
 /* Exec system call implementation */
 int do_exec(const char* path, char* const argv[]);
 
+/* Spawn system call implementation: start a program in a new child
+   process built straight from its image, without cloning the caller's
+   address space. Returns the child's PID, -1 or -EFAULT. */
+pid_t do_spawn(const char* path, char* const argv[]);
+
 #endif /* KERNEL_EXEC_H */
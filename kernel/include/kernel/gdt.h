@@ -8,11 +8,16 @@
 /* GDT initialization function */
 void gdt_init(void);
 
+/* Set the kernel stack the CPU switches to when an interrupt arrives in
+   user mode (the TSS esp0) */
+void gdt_set_kernel_stack(unsigned int esp0);
+
 /* Segment selectors */
 #define GDT_KERNEL_CODE 0x08
 #define GDT_KERNEL_DATA 0x10
 #define GDT_USER_CODE   0x1B
 #define GDT_USER_DATA   0x23
+#define GDT_TSS         0x28
 /* Compile-time sanity checks: kernel selectors must have RPL 0, user selectors RPL 3 */
 #if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
 _Static_assert((GDT_KERNEL_CODE & 0x3) == 0, "GDT_KERNEL_CODE must have RPL 0");
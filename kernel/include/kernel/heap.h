@@ -6,21 +6,35 @@
 
 #include <stdint.h>
 
-/* Heap block header */
+/* Block header. The tag holds the block size (tags included, a multiple
+   of HEAP_ALIGN) with HEAP_TAG_USED set while the block is allocated; a
+   copy of the tag ends every block as its footer. Building with
+   -DHEAP_DEBUG adds a magic word to catch invalid frees, and
+   -DHEAP_PROFILE records the allocating call site. */
 typedef struct heap_block {
-    uint32_t size;
+    uint32_t tag;
+#ifdef HEAP_DEBUG
     uint32_t magic;
-    struct heap_block* next;
-    struct heap_block* prev;
-    uint32_t is_free;
+#endif
+#ifdef HEAP_PROFILE
+    uint32_t site_slot;     /* Index into the call-site table */
+#endif
 } heap_block_t;
 
-/* Magic number for heap blocks */
+#define HEAP_TAG_USED 1U
+
+/* Magic number for heap blocks (HEAP_DEBUG only) */
 #define HEAP_MAGIC 0xDEADBEEF
 
 /* Heap alignment */
 #define HEAP_ALIGN 16
 
+/* Default trimming hysteresis: free pages at the end of the heap are
+   unmapped once more than HEAP_TRIM_THRESHOLD bytes are free there, and
+   HEAP_TRIM_KEEP bytes are left mapped for the next allocation */
+#define HEAP_TRIM_THRESHOLD (64 * 1024)
+#define HEAP_TRIM_KEEP (16 * 1024)
+
 /* Initialize kernel heap */
 void heap_init(void* start, uint32_t size);
 
@@ -37,5 +51,30 @@ void* krealloc(void* ptr, uint32_t size);
 uint32_t heap_get_total_size(void);
 uint32_t heap_get_used_size(void);
 uint32_t heap_get_free_size(void);
+uint32_t heap_get_mapped_size(void);
+uint32_t heap_get_peak_size(void);
+
+/* Call sites tracked by the HEAP_PROFILE build; allocations from further
+   sites are counted together as "other" */
+#define HEAP_PROFILE_SITES 128
+
+/* Per-call-site allocation statistics (HEAP_PROFILE builds) */
+typedef struct {
+    uint32_t site;          /* Return address of the kmalloc/krealloc call */
+    uint32_t allocs;        /* Allocations made since boot */
+    uint32_t live_count;    /* Allocations not yet freed */
+    uint32_t live_bytes;    /* Block bytes currently held */
+    uint32_t peak_bytes;    /* High-water mark of live_bytes */
+} heap_site_stats_t;
+
+/* Print the call sites holding the most heap memory */
+void heap_profile_print(uint32_t max_sites);
+
+/* Write every tracked call site to the serial port */
+void heap_profile_dump_serial(void);
+
+/* Set trimming hysteresis (bytes free at the tail before trimming, bytes
+   kept mapped after) */
+void heap_set_trim(uint32_t threshold, uint32_t keep);
 
 #endif /* KERNEL_HEAP_H */
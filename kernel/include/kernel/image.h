@@ -0,0 +1,50 @@
+/* SYNAPSE SO - Program Images */
+/* Licensed under GPLv3 */
+
+#ifndef KERNEL_IMAGE_H
+#define KERNEL_IMAGE_H
+
+#include <stdint.h>
+
+/* A program file held in kernel memory. File-backed regions point into
+   it and fill their pages from it on first touch, so it lives as long as
+   any region (or loader) holds a reference. Identical files share one
+   image, and with it the image's page cache. */
+typedef struct image {
+    uint8_t* data;      /* Kernel copy of the file (kmalloc) */
+    uint32_t size;      /* Bytes in data */
+    uint32_t hash;      /* Content hash, for finding an identical image */
+    uint32_t refs;      /* References held by regions and loaders */
+    uint32_t pages;     /* Entries in frames */
+    uint32_t* frames;   /* Page cache: frame per file page, or 0 */
+    struct image* next; /* Next open image */
+} image_t;
+
+/* Image statistics */
+typedef struct {
+    uint32_t images;        /* Open images */
+    uint32_t cached_pages;  /* Frames held by page caches */
+    uint32_t hits;          /* Page lookups served from a cache */
+    uint32_t fills;         /* Page lookups that filled a frame */
+} image_stats_t;
+
+/* Image for a kmalloc'd file copy, taking ownership of data (it is
+   freed on failure). If an identical file is already open its image is
+   returned and data is freed. The caller holds one reference. */
+image_t* image_open(uint8_t* data, uint32_t size);
+
+/* Take and drop references; the last drop frees the data and the
+   image's cached frames */
+void image_get(image_t* image);
+void image_put(image_t* image);
+
+/* Cached frame holding the page-aligned file page at offset, filled on
+   first use. The frame is shared by every mapping of that page: it must
+   be mapped read-only or copy-on-write. The caller gets its own
+   reference. Returns 0 on failure. */
+uint32_t image_page_frame(image_t* image, uint32_t offset);
+
+/* Get image and page cache statistics */
+void image_get_stats(image_stats_t* stats);
+
+#endif /* KERNEL_IMAGE_H */
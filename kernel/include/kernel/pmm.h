@@ -19,6 +19,26 @@
 #define FRAME_FREE 0
 #define FRAME_USED 1
 
+/* Largest buddy block: 2^10 frames = 4MB */
+#define PMM_MAX_ORDER 10
+
+/* Stack batch size for callers of the bulk frame APIs */
+#define PMM_BULK_BATCH 32
+
+/* Per-CPU frame cache: capacity, and batch size moved on refill/drain */
+#define PMM_MAX_CPUS 1
+#define PMM_CACHE_SIZE 32
+#define PMM_CACHE_BATCH_ORDER 4
+#define PMM_CACHE_BATCH (1U << PMM_CACHE_BATCH_ORDER)
+
+/* Pre-zeroed frame pool: capacity, and free frames always left alone
+   by background refills */
+#define PMM_ZERO_POOL_SIZE 64
+#define PMM_ZERO_POOL_RESERVE 256
+
+/* Returned by internal frame-index allocators when nothing is free */
+#define PMM_NO_FRAME 0xFFFFFFFFU
+
 /* Memory map entry from Multiboot */
 typedef struct {
     uint32_t base_addr_low;
@@ -43,6 +63,23 @@ uint32_t pmm_alloc_frame(void);
 /* Free a physical frame */
 void pmm_free_frame(uint32_t frame_addr);
 
+/* Allocate `count` frames (not necessarily contiguous) into `frames`.
+   All or nothing: returns 0 on success, -1 if memory ran out. */
+int pmm_alloc_frames_bulk(uint32_t* frames, uint32_t count);
+
+/* Drop one reference to each of `count` frames, freeing the ones that
+   reach zero. The array is used as scratch space and is clobbered. */
+void pmm_free_frames_bulk(uint32_t* frames, uint32_t count);
+
+/* Allocate a frame whose contents are zero (returns 0 on failure) */
+uint32_t pmm_alloc_zeroed_frame(void);
+
+/* Allocate 2^order physically contiguous frames (returns 0 on failure) */
+uint32_t pmm_alloc_frames(uint32_t order);
+
+/* Free 2^order contiguous frames returned by pmm_alloc_frames */
+void pmm_free_frames(uint32_t frame_addr, uint32_t order);
+
 /* Get number of free frames */
 uint32_t pmm_get_free_frames(void);
 
@@ -56,9 +93,22 @@ void pmm_init_kernel_heap(uint32_t start, uint32_t size);
 void* pmm_kmalloc(uint32_t size);
 void pmm_kfree(void* ptr, uint32_t size);
 
+/* PMM metadata region, placed after the kernel image by pmm_init */
+void* pmm_metadata_alloc(uint32_t size);
+void pmm_get_metadata_region(uint32_t* start, uint32_t* end);
+
+/* Reach the metadata at virt_start, where the VMM has mapped the region
+   from pmm_get_metadata_region, instead of at its physical address.
+   Called once by vmm_init, as paging is turned on. */
+void pmm_relocate_metadata(uint32_t virt_start);
+
 /* Reference counting for COW support */
 void pmm_refcount_init(uint32_t total_frames);
 
+/* Bytes of metadata the refcount table needs for total_frames */
+uint32_t pmm_refcount_metadata_size(uint32_t total_frames);
+void pmm_refcount_relocate(uint32_t delta);
+
 /* Increment reference count for a frame */
 void pmm_ref_frame(uint32_t frame_addr);
 
@@ -68,15 +118,66 @@ void pmm_unref_frame(uint32_t frame_addr);
 /* Get reference count for a frame */
 uint32_t pmm_get_ref_count(uint32_t frame_addr);
 
+/* Give freshly allocated frames (count 0) their first reference */
+void pmm_ref_frames_bulk(const uint32_t* frames, uint32_t count);
+
+/* Decrement reference counts; compacts `frames` down to the ones that
+   reached 0 and returns how many there are */
+uint32_t pmm_unref_frames_bulk(uint32_t* frames, uint32_t count);
+
+/* Buddy allocator (implemented in pmm_buddy.c, used by pmm.c) */
+uint32_t pmm_buddy_metadata_size(uint32_t total_frames);
+int pmm_buddy_init(uint32_t total_frames);
+void pmm_buddy_relocate(uint32_t delta);
+int pmm_buddy_is_ready(void);
+void pmm_buddy_add_range(uint32_t start_frame, uint32_t count);
+uint32_t pmm_buddy_alloc(uint32_t order);
+void pmm_buddy_free(uint32_t frame, uint32_t order);
+uint32_t pmm_buddy_free_frames(void);
+
 /* PMM statistics */
 typedef struct {
     uint32_t total_frames;
     uint32_t used_frames;
     uint32_t free_frames;
     uint32_t shared_frames;  /* Frames with refcount > 1 */
+
+    /* Pre-zeroed frame pool */
+    uint32_t zeroed_frames;  /* Frames waiting in the pool */
+    uint32_t zero_hits;      /* Zeroed allocations served from the pool */
+    uint32_t zero_misses;    /* Zeroed allocations that zeroed inline */
+
+    /* Per-CPU frame cache */
+    uint32_t cached_frames;  /* Free frames parked in caches */
+    uint32_t cache_hits;     /* Allocations served from a cache */
+    uint32_t cache_misses;   /* Allocations that found the cache empty */
+    uint32_t cache_refills;  /* Batches taken from the global allocator */
+    uint32_t cache_drains;   /* Batches returned to the global allocator */
 } pmm_stats_t;
 
 /* Get PMM statistics */
 void pmm_get_stats(pmm_stats_t* stats);
 
+/* Fill in frame cache counters (implemented in pmm.c) */
+void pmm_get_cache_stats(pmm_stats_t* stats);
+
+/* Pre-zeroed frame pool (implemented in pmm_zero.c) */
+uint32_t pmm_zero_pool_take(void);
+int pmm_zero_pool_refill(void);
+void pmm_get_zero_pool_stats(pmm_stats_t* stats);
+
+/* Save EFLAGS and disable interrupts */
+static inline uint32_t pmm_irq_save(void) {
+    uint32_t flags;
+    __asm__ volatile("pushf; pop %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+/* Restore the interrupt flag saved by pmm_irq_save */
+static inline void pmm_irq_restore(uint32_t flags) {
+    if (flags & (1 << 9)) {
+        __asm__ volatile("sti" ::: "memory");
+    }
+}
+
 #endif /* KERNEL_PMM_H */
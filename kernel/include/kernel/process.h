@@ -7,6 +7,7 @@
 #include <stdint.h>
 #include <kernel/vmm.h>
 #include <kernel/const.h>
+#include <kernel/vma.h>
 
 /* Process ID */
 typedef uint32_t pid_t;
@@ -32,6 +33,10 @@ typedef struct process {
     uint32_t heap_end;
     uint32_t stack_start;
     uint32_t stack_end;
+    vma_t* vmas;            /* Demand-paged regions, in address order */
+
+    /* Kernel stack for interrupts taken in user mode (kmalloc), or 0 */
+    uint32_t kernel_stack;
 
     /* CPU context */
     uint32_t esp;
@@ -65,6 +70,20 @@ process_t* process_create(const char* name, uint32_t flags,
 process_t* process_create_current(const char* name);
 void process_destroy(process_t* proc);
 
+/* Give a user process a kernel stack holding its first return to user
+   mode: eip = entry, on its user stack. Returns 0, or -1 if the stack
+   cannot be allocated. */
+int process_init_user_stack(process_t* proc, uint32_t entry);
+
+/* Give a forked user process its own kernel stack, resuming from a copy of
+   the parent's system call frame with 0 in eax. Returns 0, or -1 if the
+   parent has no kernel stack or the stack cannot be allocated. */
+int process_fork_user_stack(process_t* child, const process_t* parent);
+
+/* Process control block allocation (slab-backed) */
+process_t* process_alloc(void);
+void process_free(process_t* proc);
+
 /* Insert a process into the global process list. */
 void process_add_to_list(process_t* proc);
 
@@ -13,5 +13,7 @@ int serial_is_initialized(void);
 
 void serial_write_char(char c);
 void serial_write(const char* str);
+void serial_write_dec(uint32_t num);
+void serial_write_hex(uint32_t num);
 
 #endif /* KERNEL_SERIAL_H */
@@ -0,0 +1,72 @@
+/* SYNAPSE SO - Slab Allocator */
+/* Licensed under GPLv3 */
+
+#ifndef KERNEL_SLAB_H
+#define KERNEL_SLAB_H
+
+#include <stdint.h>
+
+/* Largest slab: 2^3 frames = 32KB */
+#define SLAB_MAX_ORDER 3
+
+/* Objects a slab should hold before a larger slab order is tried */
+#define SLAB_MIN_OBJECTS 8
+
+/* Default object alignment */
+#define SLAB_ALIGN 8
+
+/* Object constructor, run once per object when its slab is created */
+typedef void (*kmem_ctor_t)(void* obj);
+
+/* Slab header, stored at the start of every slab */
+typedef struct kmem_slab {
+    struct kmem_slab* next;
+    struct kmem_slab* prev;
+    struct kmem_cache* cache;
+    void* free_list;        /* Free objects, linked via link_offset */
+    uint32_t in_use;        /* Allocated objects in this slab */
+} kmem_slab_t;
+
+/* Object cache: slabs of equally sized objects */
+typedef struct kmem_cache {
+    char name[32];
+    uint32_t object_size;   /* Size including link and alignment padding */
+    uint32_t link_offset;   /* Where a free object keeps its list link */
+    uint32_t align;
+    uint32_t slab_order;    /* Each slab is 2^slab_order frames */
+    uint32_t objects_per_slab;
+    uint32_t color_max;     /* Largest coloring offset that still fits */
+    uint32_t color_next;    /* Offset for the next slab created */
+    kmem_ctor_t ctor;
+
+    kmem_slab_t* partial;   /* Slabs with free and allocated objects */
+    kmem_slab_t* full;      /* Slabs with no free objects */
+    kmem_slab_t* empty;     /* At most one fully free slab kept for reuse */
+
+    uint32_t total_slabs;
+    uint32_t active_objects;
+
+    struct kmem_cache* next;
+} kmem_cache_t;
+
+/* Initialize the slab allocator (after pmm_init and vmm_init) */
+void slab_init(void);
+
+/* Create an object cache (align 0 selects SLAB_ALIGN, ctor may be 0) */
+kmem_cache_t* kmem_cache_create(const char* name, uint32_t size,
+                                uint32_t align, kmem_ctor_t ctor);
+
+/* Destroy an object cache; fails if objects are still allocated */
+int kmem_cache_destroy(kmem_cache_t* cache);
+
+/* Allocate an object (returns 0 on failure) */
+void* kmem_cache_alloc(kmem_cache_t* cache);
+
+/* Return an object to its cache. Objects built by a constructor must be
+   freed in their constructed state. */
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+
+/* Print per-cache statistics */
+void slab_print_stats(void);
+
+#endif /* KERNEL_SLAB_H */
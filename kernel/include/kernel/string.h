@@ -25,4 +25,7 @@ void* memcpy(void* dest, const void* src, unsigned int n);
 /* Set memory */
 void* memset(void* s, int c, unsigned int n);
 
+/* Compare memory */
+int memcmp(const void* s1, const void* s2, unsigned int n);
+
 #endif /* KERNEL_STRING_H */
@@ -19,6 +19,8 @@
 #define SYS_WAIT     8
 #define SYS_GETPID   9
 #define SYS_LSEEK    10
+#define SYS_BRK      11
+#define SYS_SPAWN    12
 
 /* Maximum number of system calls */
 #define NUM_SYSCALLS 64
@@ -48,6 +50,8 @@ int sys_exec(uint32_t path, uint32_t argv);
 int sys_wait(uint32_t pid, uint32_t status);
 int sys_getpid(void);
 int sys_lseek(int fd, int offset, int whence);
+int sys_brk(uint32_t addr);
+int sys_spawn(uint32_t path, uint32_t argv);
 
 uint32_t syscall_get_num(registers_t* regs);
 void syscall_set_return(registers_t* regs, uint32_t value);
@@ -0,0 +1,42 @@
+/* SYNAPSE SO - User Memory Access */
+/* Licensed under GPLv3 */
+
+#ifndef KERNEL_UACCESS_H
+#define KERNEL_UACCESS_H
+
+#include <stdint.h>
+
+#include <kernel/idt.h>
+
+/* User space starts above the identity-mapped first 4MB (kernel image,
+   early heap, VGA memory), which is supervisor-only but present in every
+   address space, and ends where the kernel half begins */
+#define USER_SPACE_START 0x00400000U
+#define USER_SPACE_END   0xC0000000U
+
+/* The copy routines access user memory directly through the current
+   address space. A fault on a bad user pointer is caught by the page
+   fault handler, which resumes at a fixup recorded in the __ex_table
+   section, and the routine fails with -EFAULT. Copy-on-write pages are
+   handled as usual, since CR0.WP makes kernel writes honour read-only
+   PTEs. */
+
+/* Check that [addr, addr + size) lies in user space */
+int uaccess_ok(uint32_t addr, uint32_t size);
+
+/* Copy n bytes to user space, returns 0 or -EFAULT */
+int copy_to_user(void* user_dst, const void* src, uint32_t n);
+
+/* Copy n bytes from user space, returns 0 or -EFAULT */
+int copy_from_user(void* dst, const void* user_src, uint32_t n);
+
+/* Copy a NUL-terminated string of at most n bytes from user space.
+   Returns its length without the NUL, n if no NUL was found (dst is then
+   not terminated), or -EFAULT. */
+int strncpy_from_user(char* dst, const char* user_src, uint32_t n);
+
+/* Point a faulting kernel context at its fixup, if the faulting
+   instruction has one; returns 1 if the fault was fixed up */
+int uaccess_fixup(registers_t* regs);
+
+#endif /* KERNEL_UACCESS_H */
@@ -9,6 +9,9 @@
 /* Maximum open files */
 #define MAX_OPEN_FILES 256
 
+/* Maximum path length, including the terminating NUL */
+#define VFS_MAX_PATH 256
+
 /* Seek constants */
 #define SEEK_SET 0
 #define SEEK_CUR 1
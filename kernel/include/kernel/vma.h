@@ -0,0 +1,66 @@
+/* SYNAPSE SO - Virtual Memory Areas */
+/* Licensed under GPLv3 */
+
+#ifndef KERNEL_VMA_H
+#define KERNEL_VMA_H
+
+#include <stdint.h>
+
+struct process;
+struct image;
+
+/* VMA flags */
+#define VMA_READ   (1 << 0)
+#define VMA_WRITE  (1 << 1)
+#define VMA_EXEC   (1 << 2)
+#define VMA_STACK  (1 << 3)  /* User stack */
+#define VMA_HEAP   (1 << 4)  /* brk heap */
+
+/* A page-aligned region of a user address space. Pages of a region are
+   only backed by frames once touched: a not-present fault inside it maps
+   a zeroed frame, with the bytes of [file_start, file_end) copied in
+   from the region's image if it has one. */
+typedef struct vma {
+    uint32_t start;         /* First byte, page aligned */
+    uint32_t end;           /* One past the last byte, page aligned */
+    uint32_t flags;         /* VMA_* */
+    struct image* image;    /* Backing program image, or 0 if anonymous */
+    uint32_t offset;        /* Image offset of file_start */
+    uint32_t file_start;    /* File data covers [file_start, file_end) */
+    uint32_t file_end;
+    struct vma* next;       /* Next region, in address order */
+} vma_t;
+
+/* Create the VMA object cache */
+void vma_init(void);
+
+/* Register [start, end) (rounded out to pages) with a process; fails if it
+   overlaps an existing region or reaches the kernel half */
+int vma_add(struct process* proc, uint32_t start, uint32_t end,
+            uint32_t flags);
+
+/* Register a region backed by filesz bytes of an image at offset, mapped
+   at vaddr; the rest of [vaddr, end) is zero filled. The region takes a
+   reference to the image. */
+int vma_add_file(struct process* proc, uint32_t vaddr, uint32_t end,
+                 uint32_t flags, struct image* image, uint32_t offset,
+                 uint32_t filesz);
+
+/* Region containing addr, or 0 */
+vma_t* vma_find(struct process* proc, uint32_t addr);
+
+/* Give dst a copy of src's regions, sharing their images (fork) */
+int vma_copy(struct process* dst, struct process* src);
+
+/* Drop all regions of a process (mappings are left to the directory) */
+void vma_free_all(struct process* proc);
+
+/* Move the current process's program break, growing or shrinking its heap
+   region; pages given back are unmapped */
+int vma_brk(struct process* proc, uint32_t new_brk);
+
+/* Fill a not-present page of the current process on first touch; returns
+   0 if the fault was handled */
+int vma_handle_fault(uint32_t fault_addr, uint32_t error_code);
+
+#endif /* KERNEL_VMA_H */
@@ -6,6 +6,8 @@
 
 #include <stdint.h>
 
+#include <kernel/idt.h>
+
 /* Memory layout */
 #define KERNEL_VIRT_START 0xC0000000U
 #define KERNEL_PHYS_BASE  0x00100000U
@@ -21,10 +23,16 @@
 #define PAGE_NOCACHE    (1 << 4)
 #define PAGE_ACCESSED   (1 << 5)
 #define PAGE_DIRTY      (1 << 6)
-#define PAGE_GLOBAL     (1 << 8)
+#define PAGE_LARGE      (1 << 7)  /* PDE maps a 4MB page (needs CR4.PSE) */
+#define PAGE_GLOBAL     (1 << 8)  /* Kept across CR3 reloads (needs CR4.PGE) */
 #define PAGE_COW        (1 << 9)  /* Copy-on-Write flag (custom, uses available bit) */
+#define PAGE_SHARED_TABLE (1 << 10)  /* PDE: table shared copy-on-write by fork (custom) */
 #define PAGE_FRAME(addr) ((addr) & 0xFFFFF000)
 
+/* Large (PSE) pages: one PDE maps 4MB, backed by an order-10 frame block */
+#define LARGE_PAGE_SIZE  0x400000U
+#define LARGE_PAGE_ORDER 10U
+
 /* Page directory and table structures */
 typedef struct {
     uint32_t entries[1024];
@@ -53,9 +61,86 @@ void vmm_unmap_page(uint32_t virt_addr);
 /* Unmap a virtual page without freeing the physical frame */
 void vmm_unmap_page_no_free(uint32_t virt_addr);
 
+/* Map a 4MB page (virt and phys 4MB aligned), returns -1 if large pages
+   are unavailable or the range already has a page table */
+int vmm_map_large_page(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags);
+
+/* Allocate a 4MB frame block and map it as a large page; callers fall
+   back to 4KB pages on failure */
+int vmm_alloc_large_page(uint32_t virt_addr, uint32_t flags);
+
+/* Unmap a large page and free its frames */
+void vmm_unmap_large_page(uint32_t virt_addr);
+
+/* Check whether large pages can be used */
+int vmm_large_pages_enabled(void);
+
+/* Map `count` consecutive pages at virt_addr to the given frames, with a
+   single batched TLB flush */
+void vmm_map_range(uint32_t virt_addr, const uint32_t* frames, uint32_t count,
+                   uint32_t flags);
+
+/* Unmap `count` consecutive pages, freeing their frames in bulk, with a
+   single batched TLB flush */
+void vmm_unmap_range(uint32_t virt_addr, uint32_t count);
+
+/* Deferred TLB invalidation. Up to VMM_FLUSH_MAX pages are flushed with
+   invlpg; past that one full flush is cheaper. */
+#define VMM_FLUSH_MAX 32
+
+typedef struct {
+    uint32_t count;     /* Pages queued (may exceed VMM_FLUSH_MAX) */
+    uint32_t global;    /* Set if a kernel (possibly global) page is queued */
+    uint32_t addrs[VMM_FLUSH_MAX];
+} vmm_flush_batch_t;
+
+/* Start an empty batch */
+void vmm_flush_batch_init(vmm_flush_batch_t* batch);
+
+/* Queue a page whose mapping changed */
+void vmm_flush_batch_add(vmm_flush_batch_t* batch, uint32_t virt_addr);
+
+/* Flush everything queued and empty the batch */
+void vmm_flush_batch_finish(vmm_flush_batch_t* batch);
+
 /* Get physical address of a virtual page */
 uint32_t vmm_get_phys_addr(uint32_t virt_addr);
 
+/* Recursive page directory mapping. PDE 1023 of every directory points at
+   the directory itself, so the live address space's page tables appear at
+   VMM_PAGE_TABLES and the directory at VMM_PAGE_DIR. PDE 1022 of the live
+   directory can be pointed at another directory, whose tables then appear
+   at VMM_FOREIGN_TABLES, so it can be edited without a CR3 switch. */
+#define VMM_FOREIGN_SLOT   1022U
+#define VMM_RECURSIVE_SLOT 1023U
+#define VMM_FOREIGN_TABLES 0xFF800000U
+#define VMM_FOREIGN_DIR    0xFFBFF000U
+#define VMM_PAGE_TABLES    0xFFC00000U
+#define VMM_PAGE_DIR       0xFFFFF000U
+
+/* Page table `index` of a directory, reached through the recursive slot if
+   it is live and the foreign slot otherwise; 0 if the PDE is not present
+   or maps a large page. A foreign table stays valid until the next call
+   for another directory, so callers keep interrupts off while using it. */
+page_table_t* vmm_get_page_table(page_directory_t* pd, uint32_t index);
+
+/* Map a page in any address space without switching to it; returns -1 if
+   a page table cannot be allocated */
+int vmm_map_page_in(page_directory_t* pd, uint32_t virt_addr,
+                    uint32_t phys_addr, uint32_t flags);
+
+/* Map `count` consecutive pages in any address space; on failure nothing
+   is mapped */
+int vmm_map_range_in(page_directory_t* pd, uint32_t virt_addr,
+                     const uint32_t* frames, uint32_t count, uint32_t flags);
+
+/* Unmap `count` pages of any address space and release their frames */
+void vmm_unmap_range_in(page_directory_t* pd, uint32_t virt_addr,
+                        uint32_t count);
+
+/* Get the physical address of a virtual page in any address space */
+uint32_t vmm_get_phys_addr_in(page_directory_t* pd, uint32_t virt_addr);
+
 /* Allocate a new page directory for a process */
 page_directory_t* vmm_create_page_directory(void);
 
@@ -66,13 +151,28 @@ void vmm_destroy_page_directory(page_directory_t* pd);
 void vmm_switch_page_directory(page_directory_t* pd);
 
 /* Page fault handler */
-void vmm_page_fault_handler(uint32_t error_code);
+void vmm_page_fault_handler(registers_t* regs);
 
 /* Flush TLB entry */
 static inline void vmm_flush_tlb(uint32_t addr) {
     __asm__ volatile("invlpg (%0)" : : "r"(addr) : "memory");
 }
 
+/* CR4 bit enabling global pages */
+#define CR4_PGE (1U << 7)
+
+/* Flush the whole TLB, including global kernel entries that survive a CR3
+   reload; only needed when a global mapping changes without invlpg */
+void vmm_flush_tlb_all(void);
+
+/* Turn global pages on or off; toggling CR4.PGE flushes the whole TLB.
+   Returns whether they were on. Only turn them back on if they were. */
+int vmm_set_global_pages(int enable);
+
+/* Flush every non-global TLB entry (user pages and the page table
+   windows) by reloading CR3 */
+void vmm_flush_tlb_user(void);
+
 /* Get current page directory */
 page_directory_t* vmm_get_current_directory(void);
 
@@ -80,6 +180,16 @@ page_directory_t* vmm_get_current_directory(void);
 #define TEMP_MAPPING_BASE 0xE0000000  /* Temporary mapping region at 3.5GB */
 #define TEMP_MAPPING_PAGES 256          /* 256 pages = 1MB */
 
+/* Slab region: one page table's worth, created in vmm_init and shared by
+   every address space like the temporary mapping area */
+#define SLAB_VIRT_BASE  0xE0400000U
+#define SLAB_VIRT_PAGES 1024U
+
+/* PMM metadata region: the bitmap, refcount table and buddy arrays,
+   mapped in vmm_init so every address space reaches them */
+#define PMM_META_VIRT_BASE 0xE0800000U
+#define PMM_META_VIRT_SIZE 0x01000000U
+
 /* Allocate a temporary mapping slot (returns slot index or -1 on failure) */
 int vmm_alloc_temp_slot(void);
 
@@ -92,13 +202,35 @@ uint32_t vmm_map_temp_page(uint32_t phys_addr, int slot);
 /* Unmap a temporary page for a specific slot */
 void vmm_unmap_temp_page(int slot);
 
+/* Atomic kmaps: KMAP_SLOTS fixed slots per CPU just above the temporary
+   mapping area, handed out as a stack. Mapping writes the slot's PTE
+   directly, with no slot search or page table walk. Interrupts stay off
+   while a kmap is held, and kmaps are released in reverse order. */
+#define KMAP_BASE  (TEMP_MAPPING_BASE + TEMP_MAPPING_PAGES * PAGE_SIZE)
+#define KMAP_SLOTS 16
+
+/* Map a frame into the next free kmap slot, returns its address or 0 if
+   every slot is in use */
+uint32_t vmm_kmap_atomic(uint32_t phys_addr);
+
+/* Release the most recent kmap and restore the interrupt flag */
+void vmm_kunmap_atomic(uint32_t virt_addr);
+
 /* Get current CR3 (physical address of page directory) */
 uint32_t vmm_get_cr3(void);
 
 /* Copy-on-Write (COW) support */
-/* Clone a page directory for fork() - marks pages as COW */
+/* Clone a page directory for fork(). User page tables are shared by both
+   directories, read-only at the PDE, until either side writes into or
+   remaps that 4MB region. */
 page_directory_t* vmm_clone_page_directory(page_directory_t* src);
 
+/* Give a directory its own copy of a page table it shares after fork,
+   marking the writable pages of both copies COW; a table no longer
+   shared is just made writable again. Returns 0 if the table at index
+   is private on return. */
+int vmm_unshare_page_table(page_directory_t* pd, uint32_t index);
+
 /* Handle COW page fault - copies page on write */
 int vmm_handle_cow_fault(uint32_t fault_addr);
 
@@ -112,6 +244,9 @@ typedef struct {
     uint32_t free_pages;
     uint32_t cow_pages;
     uint32_t shared_pages;
+    uint32_t shared_tables; /* Page tables shared with another directory */
+    uint32_t cow_copies;    /* COW faults that copied the page */
+    uint32_t cow_reuses;    /* COW faults that kept a sole-owner frame */
 } vmm_stats_t;
 
 /* Get VMM statistics */
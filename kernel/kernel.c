@@ -7,6 +7,7 @@
 #include <kernel/pmm.h>
 #include <kernel/vmm.h>
 #include <kernel/heap.h>
+#include <kernel/slab.h>
 #include <kernel/process.h>
 #include <kernel/scheduler.h>
 #include <kernel/timer.h>
@@ -23,6 +24,7 @@
 #include <kernel/vfs.h>
 #include <kernel/ramfs.h>
 #include <kernel/string.h>
+#include <kernel/bench.h>
 
 /* Multiboot information structure */
 typedef struct {
@@ -71,6 +73,10 @@ static void shell_help(void) {
     vga_print("  help        - Show this help\n");
     vga_print("  ticks       - Show timer ticks\n");
     vga_print("  ps          - List processes\n");
+    vga_print("  heap        - Show top kernel heap users\n");
+    vga_print("  heap serial - Dump heap profile to serial\n");
+    vga_print("  bench       - Time address space switches\n");
+    vga_print("  bench spawn - Time fork+exec vs spawn\n");
     vga_print("  fork        - Run fork demo\n");
     vga_print("  cat <path>  - Print file (ramfs/vfs)\n");
     vga_print("  clear       - Clear screen\n");
@@ -125,6 +131,18 @@ static void shell_cat(const char* path) {
     vga_print("\n");
 }
 
+static void shell_heap(void) {
+    vga_print("Heap: ");
+    vga_print_dec(heap_get_used_size() / 1024);
+    vga_print(" KB used, ");
+    vga_print_dec(heap_get_mapped_size() / 1024);
+    vga_print(" KB mapped (peak ");
+    vga_print_dec(heap_get_peak_size() / 1024);
+    vga_print(" KB)\n");
+
+    heap_profile_print(10);
+}
+
 static void shell_process(void) {
     vga_print("\n[+] SYNAPSE SO Shell v0.3\n");
     vga_print("[+] Type 'help' for commands\n\n");
@@ -161,6 +179,27 @@ static void shell_process(void) {
             continue;
         }
 
+        if (strcmp(line, "heap") == 0) {
+            shell_heap();
+            continue;
+        }
+
+        if (strcmp(line, "heap serial") == 0) {
+            heap_profile_dump_serial();
+            vga_print("[heap] profile written to serial\n");
+            continue;
+        }
+
+        if (strcmp(line, "bench") == 0) {
+            bench_context_switch(1000);
+            continue;
+        }
+
+        if (strcmp(line, "bench spawn") == 0) {
+            bench_spawn(10);
+            continue;
+        }
+
         if (strcmp(line, "fork") == 0) {
             vga_print("[SHELL] Running fork demo...\n");
             pid_t pid = do_fork();
@@ -294,8 +333,8 @@ void kernel_main(unsigned int magic, multiboot_info_t* mbi) {
     vga_set_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK);
     vga_print("\n=== PHASE 2: Memory Management ===\n");
 
-    /* Initialize early PMM heap before pmm_init() so early subsystems
-       (like frame reference counting) can allocate memory safely. */
+    /* Initialize early PMM heap before pmm_init() so it is reserved
+       and PMM metadata is placed clear of it. */
     pmm_init_kernel_heap(0x300000, 0x100000); /* 1MB at 3MB */
 
     /* Initialize Physical Memory Manager */
@@ -313,6 +352,9 @@ void kernel_main(unsigned int magic, multiboot_info_t* mbi) {
     /* Initialize proper kernel heap */
     heap_init((void*)0xC0300000, 0x100000); /* 1MB at 3GB+3MB */
 
+    /* Initialize object caches for fixed-size kernel objects */
+    slab_init();
+
     /* Initialize Process Management */
     vga_print("\n=== PHASE 2: Process Management ===\n");
     process_init();
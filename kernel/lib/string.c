@@ -73,3 +73,19 @@ void* memset(void* s, int c, unsigned int n) {
 
     return s;
 }
+
+/* Compare memory */
+int memcmp(const void* s1, const void* s2, unsigned int n) {
+    const unsigned char* p1 = (const unsigned char*)s1;
+    const unsigned char* p2 = (const unsigned char*)s2;
+
+    while (n--) {
+        if (*p1 != *p2) {
+            return *p1 - *p2;
+        }
+        p1++;
+        p2++;
+    }
+
+    return 0;
+}
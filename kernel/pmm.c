@@ -15,6 +15,15 @@ static uint32_t last_used_frame;
 /* Physical memory information */
 static uint32_t total_memory;
 
+/* End of the kernel image (defined in boot/linker.ld) */
+extern uint8_t _kernel_end[];
+
+/* PMM metadata region (bitmap, refcount table, buddy arrays), sized and
+   placed from the memory map by pmm_init */
+static uint32_t metadata_start;
+static uint32_t metadata_end;
+static uint32_t metadata_used;
+
 /* Kernel heap for pre-paging allocations */
 static uint8_t* kernel_heap;
 static uint32_t kernel_heap_phys;
@@ -42,6 +51,83 @@ static inline uint32_t frame_to_addr(uint32_t frame) {
     return frame * FRAME_SIZE;
 }
 
+/* One summary bit covers a group of 32 bitmap words (1024 frames) */
+#define BITMAP_GROUP_WORDS 32U
+#define BITMAP_GROUP_FRAMES (BITMAP_GROUP_WORDS * 32U)
+#define SUMMARY_WORDS ((MAX_FRAMES / BITMAP_GROUP_FRAMES + 32U) / 32U)
+
+/* Summary bitmap: a set bit means the group has at least one free frame */
+static uint32_t frames_summary[SUMMARY_WORDS];
+static uint32_t bitmap_words;
+
+/* Index of the lowest set bit (bsf/tzcnt), x must be non-zero */
+static inline uint32_t lowest_set_bit(uint32_t x) {
+    return (uint32_t)__builtin_ctz(x);
+}
+
+/* Number of set bits (no libgcc popcount in a freestanding kernel) */
+static inline uint32_t bit_count(uint32_t x) {
+    x = x - ((x >> 1) & 0x55555555U);
+    x = (x & 0x33333333U) + ((x >> 2) & 0x33333333U);
+    x = (x + (x >> 4)) & 0x0F0F0F0FU;
+    return (x * 0x01010101U) >> 24;
+}
+
+/* Mask covering bits [lo, hi) of a word, with lo < hi <= 32 */
+static inline uint32_t word_mask(uint32_t lo, uint32_t hi) {
+    uint32_t upper = (hi == 32U) ? 0xFFFFFFFFU : ((1U << hi) - 1U);
+    return upper & ~((1U << lo) - 1U);
+}
+
+static inline void summary_set(uint32_t group) {
+    frames_summary[group / 32U] |= (1U << (group % 32U));
+}
+
+static inline void summary_clear(uint32_t group) {
+    frames_summary[group / 32U] &= ~(1U << (group % 32U));
+}
+
+/* Recompute the summary bit of a group after frames were marked used */
+static void summary_refresh(uint32_t group) {
+    uint32_t first = group * BITMAP_GROUP_WORDS;
+    uint32_t last = first + BITMAP_GROUP_WORDS;
+    if (last > bitmap_words) {
+        last = bitmap_words;
+    }
+
+    for (uint32_t w = first; w < last; w++) {
+        if (frames_bitmap[w] != 0xFFFFFFFFU) {
+            summary_set(group);
+            return;
+        }
+    }
+
+    summary_clear(group);
+}
+
+/* First group at or after `group` whose summary bit is set */
+static uint32_t summary_find_next(uint32_t group) {
+    uint32_t groups = (bitmap_words + BITMAP_GROUP_WORDS - 1U) /
+                      BITMAP_GROUP_WORDS;
+    if (group >= groups) {
+        return PMM_NO_FRAME;
+    }
+
+    uint32_t index = group / 32U;
+    uint32_t bits = frames_summary[index] & ~((1U << (group % 32U)) - 1U);
+
+    while (bits == 0U) {
+        index++;
+        if (index * 32U >= groups) {
+            return PMM_NO_FRAME;
+        }
+        bits = frames_summary[index];
+    }
+
+    group = index * 32U + lowest_set_bit(bits);
+    return (group < groups) ? group : PMM_NO_FRAME;
+}
+
 /* Test if a frame is free */
 static inline int frame_is_free(uint32_t frame) {
     uint32_t index = frame / 32U;
@@ -55,6 +141,10 @@ static inline void frame_set_used(uint32_t frame) {
     uint32_t bit = frame % 32U;
     frames_bitmap[index] |= (1U << bit);
     used_frames++;
+
+    if (frames_bitmap[index] == 0xFFFFFFFFU) {
+        summary_refresh(index / BITMAP_GROUP_WORDS);
+    }
 }
 
 /* Set frame as free */
@@ -63,6 +153,282 @@ static inline void frame_set_free(uint32_t frame) {
     uint32_t bit = frame % 32U;
     frames_bitmap[index] &= ~(1U << bit);
     used_frames--;
+    summary_set(index / BITMAP_GROUP_WORDS);
+}
+
+/* Mark frames [start, start + count) as used, a word at a time */
+static void bitmap_set_range(uint32_t start, uint32_t count) {
+    if (start >= total_frames) {
+        return;
+    }
+    if (count > total_frames - start) {
+        count = total_frames - start;
+    }
+    if (count == 0U) {
+        return;
+    }
+
+    uint32_t end = start + count;
+    uint32_t f = start;
+    while (f < end) {
+        uint32_t index = f / 32U;
+        uint32_t bit = f % 32U;
+        uint32_t span = 32U - bit;
+        if (span > end - f) {
+            span = end - f;
+        }
+
+        uint32_t mask = word_mask(bit, bit + span);
+        used_frames += bit_count(mask & ~frames_bitmap[index]);
+        frames_bitmap[index] |= mask;
+        f += span;
+    }
+
+    for (uint32_t g = start / BITMAP_GROUP_FRAMES;
+         g <= (end - 1U) / BITMAP_GROUP_FRAMES; g++) {
+        summary_refresh(g);
+    }
+}
+
+/* Mark frames [start, start + count) as free, a word at a time */
+static void bitmap_clear_range(uint32_t start, uint32_t count) {
+    if (start >= total_frames) {
+        return;
+    }
+    if (count > total_frames - start) {
+        count = total_frames - start;
+    }
+    if (count == 0U) {
+        return;
+    }
+
+    uint32_t end = start + count;
+    uint32_t f = start;
+    while (f < end) {
+        uint32_t index = f / 32U;
+        uint32_t bit = f % 32U;
+        uint32_t span = 32U - bit;
+        if (span > end - f) {
+            span = end - f;
+        }
+
+        uint32_t mask = word_mask(bit, bit + span);
+        used_frames -= bit_count(mask & frames_bitmap[index]);
+        frames_bitmap[index] &= ~mask;
+        f += span;
+    }
+
+    for (uint32_t g = start / BITMAP_GROUP_FRAMES;
+         g <= (end - 1U) / BITMAP_GROUP_FRAMES; g++) {
+        summary_set(g);
+    }
+}
+
+/* Find the first free frame at or after `start`.
+   Fully used words are skipped whole, fully used 1024-frame groups are
+   skipped through the summary bitmap. Returns PMM_NO_FRAME if none. */
+static uint32_t bitmap_find_free(uint32_t start) {
+    if (start >= total_frames) {
+        return PMM_NO_FRAME;
+    }
+
+    uint32_t index = start / 32U;
+    uint32_t free_bits = ~frames_bitmap[index] & ~((1U << (start % 32U)) - 1U);
+    if (free_bits != 0U) {
+        return index * 32U + lowest_set_bit(free_bits);
+    }
+
+    /* Remaining words of the starting group */
+    uint32_t group_end = (index / BITMAP_GROUP_WORDS + 1U) * BITMAP_GROUP_WORDS;
+    if (group_end > bitmap_words) {
+        group_end = bitmap_words;
+    }
+    for (index++; index < group_end; index++) {
+        if (frames_bitmap[index] != 0xFFFFFFFFU) {
+            return index * 32U + lowest_set_bit(~frames_bitmap[index]);
+        }
+    }
+
+    /* Later groups: let the summary skip the full ones */
+    uint32_t group = summary_find_next(group_end / BITMAP_GROUP_WORDS);
+    if (group == PMM_NO_FRAME) {
+        return PMM_NO_FRAME;
+    }
+
+    index = group * BITMAP_GROUP_WORDS;
+    group_end = index + BITMAP_GROUP_WORDS;
+    if (group_end > bitmap_words) {
+        group_end = bitmap_words;
+    }
+    for (; index < group_end; index++) {
+        if (frames_bitmap[index] != 0xFFFFFFFFU) {
+            return index * 32U + lowest_set_bit(~frames_bitmap[index]);
+        }
+    }
+
+    /* Summary claimed a free frame that is not there */
+    return PMM_NO_FRAME;
+}
+
+/* Find the first used frame at or after `start` (total_frames if none) */
+static uint32_t bitmap_find_used(uint32_t start) {
+    if (start >= total_frames) {
+        return total_frames;
+    }
+
+    uint32_t index = start / 32U;
+    uint32_t used_bits = frames_bitmap[index] & ~((1U << (start % 32U)) - 1U);
+
+    while (used_bits == 0U) {
+        index++;
+        if (index >= bitmap_words) {
+            return total_frames;
+        }
+        used_bits = frames_bitmap[index];
+    }
+
+    uint32_t frame = index * 32U + lowest_set_bit(used_bits);
+    return (frame < total_frames) ? frame : total_frames;
+}
+
+/* Mark a run handed out by the buddy allocator as used in the bitmap.
+   The bitmap is kept as a cross-check: returns -1 if any frame in the
+   run was already marked used (the run is left untouched). */
+static int bitmap_claim_run(uint32_t frame, uint32_t count) {
+    uint32_t used = bitmap_find_used(frame);
+    if (used < frame + count) {
+        vga_print("[-] PMM: buddy/bitmap mismatch at frame 0x");
+        vga_print_hex(frame_to_addr(used));
+        vga_print("\n");
+        return -1;
+    }
+
+    bitmap_set_range(frame, count);
+    return 0;
+}
+
+/* Take 2^order frames from the buddy allocator and mark them used */
+static uint32_t buddy_alloc_checked(uint32_t order) {
+    while (1) {
+        uint32_t frame = pmm_buddy_alloc(order);
+        if (frame == PMM_NO_FRAME) {
+            return PMM_NO_FRAME;
+        }
+
+        uint32_t count = 1U << order;
+        if (bitmap_claim_run(frame, count) == 0) {
+            return frame;
+        }
+
+        /* Inconsistent block: never hand it out, but give the frames the
+           bitmap still calls free back as single frames so only the used
+           ones are lost to the buddy allocator */
+        uint32_t reclaimed = 0;
+        for (uint32_t f = frame; f < frame + count; f++) {
+            if (frame_is_free(f) != 0) {
+                pmm_buddy_free(f, 0);
+                reclaimed++;
+            }
+        }
+        vga_print("[-] PMM: dropped order-");
+        vga_print_dec(order);
+        vga_print(" block, reclaimed ");
+        vga_print_dec(reclaimed);
+        vga_print(" free frames\n");
+    }
+}
+
+/* End of a memory map entry, clamped to the 32-bit physical space */
+static uint32_t mmap_entry_end(const mem_map_entry_t* entry) {
+    if (entry->base_addr_high != 0U) {
+        return 0;
+    }
+
+    uint32_t base = entry->base_addr_low;
+    if ((entry->length_high != 0U) ||
+        (entry->length_low > (MAX_MEMORY - base))) {
+        return MAX_MEMORY & ~(FRAME_SIZE - 1U);
+    }
+
+    return base + entry->length_low;
+}
+
+/* Find the lowest page-aligned physical range of `size` bytes after the
+   kernel image that lies in available memory and stays clear of the early
+   kernel heap. Returns 0 if nothing fits. */
+static uint32_t find_metadata_region(mem_map_t* mmap, uint32_t num_entries,
+                                     uint32_t mmap_desc_size, uint32_t size) {
+    uint32_t floor = ((uint32_t)_kernel_end + (FRAME_SIZE - 1U)) &
+                     ~(FRAME_SIZE - 1U);
+    uint32_t heap_end = kernel_heap_phys + kernel_heap_size;
+    uint32_t best = 0;
+
+    mem_map_entry_t* entry = mmap->entries;
+    for (uint32_t i = 0; i < num_entries; i++) {
+        uint32_t type = entry->type;
+        uint32_t end = mmap_entry_end(entry);
+        uint32_t start = (entry->base_addr_low + (FRAME_SIZE - 1U)) &
+                         ~(FRAME_SIZE - 1U);
+        entry = (mem_map_entry_t*)((uint8_t*)entry + mmap_desc_size);
+
+        if ((type != MEM_TYPE_AVAILABLE) || (end == 0U) || (start >= end)) {
+            continue;
+        }
+        if (start < floor) {
+            start = floor;
+        }
+
+        /* Skip past the early heap if the range would overlap it */
+        if ((kernel_heap_size != 0U) && (start < heap_end) &&
+            ((start >= kernel_heap_phys) ||
+             (size > kernel_heap_phys - start))) {
+            start = (heap_end + (FRAME_SIZE - 1U)) & ~(FRAME_SIZE - 1U);
+        }
+
+        if ((start >= end) || (size > end - start)) {
+            continue;
+        }
+
+        if ((best == 0U) || (start < best)) {
+            best = start;
+        }
+    }
+
+    return best;
+}
+
+/* Carve space out of the metadata region (pmm_init only) */
+void* pmm_metadata_alloc(uint32_t size) {
+    size = (size + 3U) & ~3U;
+    if (size > (metadata_end - metadata_start) - metadata_used) {
+        return 0;
+    }
+
+    void* ptr = (void*)(metadata_start + metadata_used);
+    metadata_used += size;
+    return ptr;
+}
+
+/* Physical range holding the PMM metadata, for the VMM to map */
+void pmm_get_metadata_region(uint32_t* start, uint32_t* end) {
+    if (start != 0) {
+        *start = metadata_start;
+    }
+    if (end != 0) {
+        *end = metadata_end;
+    }
+}
+
+/* Move the metadata pointers from physical to virtual addresses */
+void pmm_relocate_metadata(uint32_t virt_start) {
+    if (metadata_start == 0U) {
+        return;
+    }
+
+    uint32_t delta = virt_start - metadata_start;
+    frames_bitmap = (uint32_t*)((uint32_t)frames_bitmap + delta);
+    pmm_refcount_relocate(delta);
+    pmm_buddy_relocate(delta);
 }
 
 /* Initialize PMM */
@@ -74,9 +440,9 @@ void pmm_init(mem_map_t* mmap, uint32_t mmap_size, uint32_t mmap_desc_size) {
     total_memory = 0;
     uint32_t num_entries = mmap_size / mmap_desc_size;
 
-    /* Find highest memory address */
+    /* Find highest memory address below 4GB */
     for (uint32_t i = 0; i < num_entries; i++) {
-        uint32_t end = entry->base_addr_low + entry->length_low;
+        uint32_t end = mmap_entry_end(entry);
         if ((entry->type == MEM_TYPE_AVAILABLE) && (end > total_memory)) {
             total_memory = end;
         }
@@ -89,86 +455,96 @@ void pmm_init(mem_map_t* mmap, uint32_t mmap_size, uint32_t mmap_desc_size) {
     last_used_frame = 0;
 
     /* Calculate bitmap size (in bytes) */
-    uint32_t bitmap_size = (total_frames + 31) / 32 * 4;
+    bitmap_words = (total_frames + 31) / 32;
+    uint32_t bitmap_size = bitmap_words * 4;
+
+    /* Size the metadata for this machine and place it after the kernel.
+       Without room for the buddy arrays, fall back to the bitmap scan. */
+    uint32_t base_size = bitmap_size + pmm_refcount_metadata_size(total_frames);
+    uint32_t full_size = base_size + pmm_buddy_metadata_size(total_frames);
+    int with_buddy = 1;
+
+    metadata_start = find_metadata_region(mmap, num_entries, mmap_desc_size,
+                                          full_size);
+    if (metadata_start == 0U) {
+        with_buddy = 0;
+        metadata_start = find_metadata_region(mmap, num_entries,
+                                              mmap_desc_size, base_size);
+    }
+    if (metadata_start == 0U) {
+        vga_print("[-] Error: No room for PMM metadata!\n");
+        total_frames = 0;
+        bitmap_words = 0;
+        return;
+    }
 
-    /* Place bitmap after kernel (assume kernel ends at 2MB for now) */
-    frames_bitmap = (uint32_t*)0x200000;
+    metadata_end = metadata_start +
+                   ((with_buddy != 0) ? full_size : base_size);
+    metadata_end = (metadata_end + (FRAME_SIZE - 1U)) & ~(FRAME_SIZE - 1U);
+    metadata_used = 0;
 
-    /* Clear bitmap */
-    for (uint32_t i = 0; i < bitmap_size / 4; i++) {
-        frames_bitmap[i] = 0;
-    }
+    /* The bitmap comes first in the metadata region */
+    frames_bitmap = (uint32_t*)pmm_metadata_alloc(bitmap_size);
 
-    /* Mark all frames as used initially, then mark available ones as free */
-    for (uint32_t i = 0; i < total_frames; i++) {
-        frame_set_used(i);
+    /* Mark all frames as used initially, then mark available ones as free.
+       Padding bits past the last frame stay set so searches never see
+       them as free. */
+    for (uint32_t i = 0; i < bitmap_words; i++) {
+        frames_bitmap[i] = 0xFFFFFFFFU;
+    }
+    for (uint32_t i = 0; i < SUMMARY_WORDS; i++) {
+        frames_summary[i] = 0;
     }
+    used_frames = total_frames;
 
     /* Mark available frames as free */
     entry = mmap->entries;
     for (uint32_t i = 0; i < num_entries; i++) {
         if (entry->type == MEM_TYPE_AVAILABLE) {
-            uint32_t start_frame = addr_to_frame(entry->base_addr_low);
-            uint32_t end_frame = addr_to_frame(entry->base_addr_low +
-                                               entry->length_low);
-
-            for (uint32_t f = start_frame; f < end_frame; f++) {
-                if (frame_is_free(f) != 0) {
-                    continue;
-                }
-                frame_set_free(f);
+            uint32_t start_frame = addr_to_frame_round_up(entry->base_addr_low);
+            uint32_t end_frame = addr_to_frame(mmap_entry_end(entry));
+            if ((entry->base_addr_high == 0U) && (end_frame > start_frame)) {
+                bitmap_clear_range(start_frame, end_frame - start_frame);
             }
         }
         entry = (mem_map_entry_t*)((uint8_t*)entry + mmap_desc_size);
     }
 
     /* Reserve low memory (0x0 - 1MB). */
-    uint32_t low_start_frame = addr_to_frame(0x00000000U);
-    uint32_t low_end_frame = addr_to_frame(0x00100000U);
-    for (uint32_t f = low_start_frame; f < low_end_frame; f++) {
-        if (frame_is_free(f) != 0) {
-            frame_set_used(f);
-        }
-    }
+    bitmap_set_range(addr_to_frame(0x00000000U), addr_to_frame(0x00100000U));
 
-    /* Mark kernel region as used (1MB to 2MB for now) */
-    uint32_t kernel_start_frame = addr_to_frame(0x00100000U);
-    uint32_t kernel_end_frame = addr_to_frame(0x00200000U);
-    for (uint32_t f = kernel_start_frame; f < kernel_end_frame; f++) {
-        if (frame_is_free(f) != 0) {
-            frame_set_used(f);
-        }
-    }
+    /* Mark the kernel image as used */
+    uint32_t kernel_end = (uint32_t)_kernel_end;
+    bitmap_set_range(addr_to_frame(0x00100000U),
+                     addr_to_frame_round_up(kernel_end) -
+                     addr_to_frame(0x00100000U));
 
-    /* Mark bitmap area as used */
-    uint32_t bitmap_start_frame = addr_to_frame(0x00200000U);
-    uint32_t bitmap_end_frame = addr_to_frame_round_up(0x00200000U + bitmap_size);
-    for (uint32_t f = bitmap_start_frame; f < bitmap_end_frame; f++) {
-        if (frame_is_free(f) != 0) {
-            frame_set_used(f);
-        }
-    }
+    /* Mark the metadata region as used */
+    bitmap_set_range(addr_to_frame(metadata_start),
+                     addr_to_frame(metadata_end) - addr_to_frame(metadata_start));
 
     /* Reserve the early kernel heap region (if configured). */
     if ((kernel_heap_phys != 0U) && (kernel_heap_size != 0U)) {
         uint32_t heap_start_frame = addr_to_frame(kernel_heap_phys);
         uint32_t heap_end_frame = addr_to_frame_round_up(kernel_heap_phys +
                                                          kernel_heap_size);
-        for (uint32_t f = heap_start_frame; f < heap_end_frame; f++) {
-            if (frame_is_free(f) != 0) {
-                frame_set_used(f);
-            }
-        }
+        bitmap_set_range(heap_start_frame, heap_end_frame - heap_start_frame);
     }
 
-    /* Initialize reference counting */
+    /* Initialize reference counting. Frames reserved above keep a count
+       of 0, so pmm_free_frame() leaves them alone. */
     pmm_refcount_init(total_frames);
 
-    /* Set initial refcount for all used frames */
-    for (uint32_t f = 0; f < total_frames; f++) {
-        if (frame_is_free(f) == 0) {
-            pmm_ref_frame(frame_to_addr(f));
+    /* Hand every free run in the bitmap to the buddy allocator */
+    if ((with_buddy != 0) && (pmm_buddy_init(total_frames) == 0)) {
+        uint32_t f = bitmap_find_free(0);
+        while (f != PMM_NO_FRAME) {
+            uint32_t run_end = bitmap_find_used(f);
+            pmm_buddy_add_range(f, run_end - f);
+            f = bitmap_find_free(run_end);
         }
+    } else {
+        vga_print("    Buddy allocator disabled, using bitmap scan\n");
     }
 
     vga_print("    Total memory: ");
@@ -180,30 +556,150 @@ void pmm_init(mem_map_t* mmap, uint32_t mmap_size, uint32_t mmap_desc_size) {
     vga_print("    Free frames: ");
     vga_print_dec(pmm_get_free_frames());
     vga_print("\n");
+    vga_print("    Metadata: 0x");
+    vga_print_hex(metadata_start);
+    vga_print(" - 0x");
+    vga_print_hex(metadata_end);
+    vga_print("\n");
 }
 
-/* Allocate a physical frame */
-uint32_t pmm_alloc_frame(void) {
+/* Take one frame from the global allocator (buddy, or bitmap search if
+   the buddy metadata could not be allocated). Returns a frame index. */
+static uint32_t global_alloc_frame(void) {
+    if (pmm_buddy_is_ready() != 0) {
+        return buddy_alloc_checked(0);
+    }
+
     /* Start from last used frame for better locality */
-    uint32_t start_frame = last_used_frame;
+    uint32_t frame = bitmap_find_free(last_used_frame);
+    if (frame == PMM_NO_FRAME) {
+        frame = bitmap_find_free(0);
+    }
+
+    if (frame != PMM_NO_FRAME) {
+        frame_set_used(frame);
+        last_used_frame = frame;
+    }
 
-    for (uint32_t i = 0; i < total_frames; i++) {
-        uint32_t frame = (start_frame + i) % total_frames;
+    return frame;
+}
 
-        if (frame_is_free(frame) != 0) {
-            frame_set_used(frame);
-            last_used_frame = frame;
+/* Return one frame to the global allocator */
+static void global_free_frame(uint32_t frame) {
+    frame_set_free(frame);
+    if (pmm_buddy_is_ready() != 0) {
+        pmm_buddy_free(frame, 0);
+    }
+}
 
-            /* Initialize reference count to 1 for newly allocated frames */
-            pmm_ref_frame(frame_to_addr(frame));
+/* Per-CPU frame cache: a stack of free frames taken from the global
+   allocator in batches. Cached frames stay marked used in the bitmap and
+   have a reference count of 0 until they are handed out. */
+typedef struct {
+    uint32_t count;
+    uint32_t frames[PMM_CACHE_SIZE];
+} pmm_frame_cache_t;
+
+static pmm_frame_cache_t frame_caches[PMM_MAX_CPUS];
+static uint32_t cached_frames;
+static uint32_t cache_hits;
+static uint32_t cache_misses;
+static uint32_t cache_refills;
+static uint32_t cache_drains;
+
+/* Cache of the running CPU (uniprocessor for now) */
+static inline pmm_frame_cache_t* pmm_this_cache(void) {
+    return &frame_caches[0];
+}
 
-            return frame_to_addr(frame);
+/* Refill a cache with up to PMM_CACHE_BATCH frames */
+static void cache_refill(pmm_frame_cache_t* cache) {
+    uint32_t wanted = PMM_CACHE_BATCH;
+    if (wanted > PMM_CACHE_SIZE - cache->count) {
+        wanted = PMM_CACHE_SIZE - cache->count;
+    }
+
+    /* Prefer a single buddy block for the whole batch */
+    if ((pmm_buddy_is_ready() != 0) && (wanted == PMM_CACHE_BATCH)) {
+        uint32_t block = buddy_alloc_checked(PMM_CACHE_BATCH_ORDER);
+        if (block != PMM_NO_FRAME) {
+            /* Push in reverse so frames are handed out in ascending order */
+            for (uint32_t i = PMM_CACHE_BATCH; i > 0U; i--) {
+                cache->frames[cache->count++] = block + i - 1U;
+            }
+            cached_frames += PMM_CACHE_BATCH;
+            cache_refills++;
+            return;
         }
     }
 
-    /* No free frames available */
-    vga_print("[-] Error: Out of physical memory!\n");
-    return 0;
+    uint32_t got = 0;
+    while (got < wanted) {
+        uint32_t frame = global_alloc_frame();
+        if (frame == PMM_NO_FRAME) {
+            break;
+        }
+        cache->frames[cache->count++] = frame;
+        got++;
+    }
+
+    if (got != 0U) {
+        cached_frames += got;
+        cache_refills++;
+    }
+}
+
+/* Give up to `count` frames from the top of a cache back to the
+   global allocator */
+static void cache_drain(pmm_frame_cache_t* cache, uint32_t count) {
+    if (count > cache->count) {
+        count = cache->count;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        global_free_frame(cache->frames[--cache->count]);
+    }
+
+    if (count != 0U) {
+        cached_frames -= count;
+        cache_drains++;
+    }
+}
+
+/* Allocate a physical frame */
+uint32_t pmm_alloc_frame(void) {
+    uint32_t flags = pmm_irq_save();
+    pmm_frame_cache_t* cache = pmm_this_cache();
+
+    if (cache->count != 0U) {
+        cache_hits++;
+    } else {
+        cache_misses++;
+        cache_refill(cache);
+    }
+
+    if (cache->count == 0U) {
+        pmm_irq_restore(flags);
+
+        /* Last resort: a frame parked in the pre-zeroed pool */
+        uint32_t zeroed = pmm_zero_pool_take();
+        if (zeroed != 0U) {
+            return zeroed;
+        }
+
+        /* No free frames available */
+        vga_print("[-] Error: Out of physical memory!\n");
+        return 0;
+    }
+
+    uint32_t frame = cache->frames[--cache->count];
+    cached_frames--;
+    pmm_irq_restore(flags);
+
+    /* Initialize reference count to 1 for newly allocated frames */
+    pmm_ref_frame(frame_to_addr(frame));
+
+    return frame_to_addr(frame);
 }
 
 /* Free a physical frame */
@@ -225,24 +721,239 @@ void pmm_free_frame(uint32_t frame_addr) {
         return;
     }
 
-    if (refcount == 1U) {
-        /* This is the last reference, free the frame */
-        pmm_unref_frame(frame_addr);
-        frame_set_free(frame);
-    } else {
-        /* There are other references, just decrement the count */
-        pmm_unref_frame(frame_addr);
+    /* Drop our reference; other mappings keep the frame alive */
+    pmm_unref_frame(frame_addr);
+    if (refcount != 1U) {
+        return;
     }
+
+    /* This was the last reference: park the frame in the local cache,
+       draining a batch to the global allocator when it is full */
+    uint32_t flags = pmm_irq_save();
+    pmm_frame_cache_t* cache = pmm_this_cache();
+
+    if (cache->count == PMM_CACHE_SIZE) {
+        cache_drain(cache, PMM_CACHE_BATCH);
+    }
+
+    cache->frames[cache->count++] = frame;
+    cached_frames++;
+    pmm_irq_restore(flags);
 }
 
-/* Get number of free frames */
+/* Allocate many frames at once: one interrupt-off section, whole buddy
+   blocks instead of single frames, and a single refcount pass */
+int pmm_alloc_frames_bulk(uint32_t* frames, uint32_t count) {
+    if ((frames == 0) || (count == 0U)) {
+        return 0;
+    }
+
+    uint32_t flags = pmm_irq_save();
+    pmm_frame_cache_t* cache = pmm_this_cache();
+    uint32_t filled = 0;
+
+    /* Use up the local cache first */
+    while ((filled < count) && (cache->count != 0U)) {
+        frames[filled++] = cache->frames[--cache->count];
+        cached_frames--;
+    }
+
+    while (filled < count) {
+        uint32_t remaining = count - filled;
+
+        if (pmm_buddy_is_ready() != 0) {
+            /* Largest block that does not overshoot the request */
+            uint32_t order = 0;
+            while ((order < PMM_MAX_ORDER) && ((2U << order) <= remaining)) {
+                order++;
+            }
+
+            uint32_t block = PMM_NO_FRAME;
+            for (;;) {
+                block = buddy_alloc_checked(order);
+                if ((block != PMM_NO_FRAME) || (order == 0U)) {
+                    break;
+                }
+                order--;
+            }
+            if (block == PMM_NO_FRAME) {
+                break;
+            }
+
+            for (uint32_t i = 0; i < (1U << order); i++) {
+                frames[filled++] = block + i;
+            }
+            last_used_frame = block;
+        } else {
+            uint32_t frame = global_alloc_frame();
+            if (frame == PMM_NO_FRAME) {
+                break;
+            }
+            frames[filled++] = frame;
+        }
+    }
+
+    if (filled < count) {
+        /* Out of memory: give back what was taken */
+        for (uint32_t i = 0; i < filled; i++) {
+            global_free_frame(frames[i]);
+        }
+        pmm_irq_restore(flags);
+
+        vga_print("[-] Error: Out of physical memory!\n");
+        return -1;
+    }
+
+    pmm_irq_restore(flags);
+
+    for (uint32_t i = 0; i < count; i++) {
+        frames[i] = frame_to_addr(frames[i]);
+    }
+    pmm_ref_frames_bulk(frames, count);
+
+    return 0;
+}
+
+/* Free many frames at once: a single refcount pass, then the frames that
+   lost their last reference refill the local cache before the rest go
+   back to the global allocator */
+void pmm_free_frames_bulk(uint32_t* frames, uint32_t count) {
+    if ((frames == 0) || (count == 0U)) {
+        return;
+    }
+
+    /* Frames the bitmap says are free have no references to drop */
+    uint32_t valid = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t frame = addr_to_frame(frames[i]);
+        if ((frame < total_frames) && (frame_is_free(frame) == 0)) {
+            frames[valid++] = frames[i];
+        }
+    }
+
+    uint32_t released = pmm_unref_frames_bulk(frames, valid);
+    if (released == 0U) {
+        return;
+    }
+
+    uint32_t flags = pmm_irq_save();
+    pmm_frame_cache_t* cache = pmm_this_cache();
+
+    for (uint32_t i = 0; i < released; i++) {
+        uint32_t frame = addr_to_frame(frames[i]);
+        if (cache->count < PMM_CACHE_SIZE) {
+            cache->frames[cache->count++] = frame;
+            cached_frames++;
+        } else {
+            global_free_frame(frame);
+        }
+    }
+
+    pmm_irq_restore(flags);
+}
+
+/* Allocate 2^order physically contiguous frames */
+uint32_t pmm_alloc_frames(uint32_t order) {
+    if (order > PMM_MAX_ORDER) {
+        return 0;
+    }
+
+    /* Single frames go through the per-CPU cache */
+    if (order == 0U) {
+        return pmm_alloc_frame();
+    }
+
+    if (pmm_buddy_is_ready() == 0) {
+        vga_print("[-] Error: Contiguous allocation needs the buddy allocator\n");
+        return 0;
+    }
+
+    uint32_t flags = pmm_irq_save();
+    uint32_t frame = buddy_alloc_checked(order);
+    if (frame == PMM_NO_FRAME) {
+        /* Cached single frames may be blocking a merge: drain and retry */
+        cache_drain(pmm_this_cache(), PMM_CACHE_SIZE);
+        frame = buddy_alloc_checked(order);
+    }
+    pmm_irq_restore(flags);
+    if (frame == PMM_NO_FRAME) {
+        vga_print("[-] Error: Out of physical memory!\n");
+        return 0;
+    }
+
+    /* Each frame of the run starts with a single reference */
+    uint32_t count = 1U << order;
+    for (uint32_t f = frame; f < frame + count; f++) {
+        pmm_ref_frame(frame_to_addr(f));
+    }
+
+    last_used_frame = frame;
+    return frame_to_addr(frame);
+}
+
+/* Free 2^order contiguous frames */
+void pmm_free_frames(uint32_t frame_addr, uint32_t order) {
+    uint32_t frame = addr_to_frame(frame_addr);
+
+    if (order > PMM_MAX_ORDER) {
+        return;
+    }
+
+    uint32_t count = 1U << order;
+    if ((frame >= total_frames) || (count > total_frames - frame)) {
+        return;
+    }
+
+    /* Return the whole block in one step if it is aligned and every frame
+       is still exclusively owned; otherwise fall back to per-frame frees so
+       shared frames keep their other references. */
+    uint32_t flags = pmm_irq_save();
+    int whole_block = (pmm_buddy_is_ready() != 0) && (order != 0U) &&
+                      ((frame & (count - 1U)) == 0U);
+    for (uint32_t f = frame; (whole_block != 0) && (f < frame + count); f++) {
+        if ((frame_is_free(f) != 0) ||
+            (pmm_get_ref_count(frame_to_addr(f)) != 1U)) {
+            whole_block = 0;
+        }
+    }
+
+    if (whole_block != 0) {
+        for (uint32_t f = frame; f < frame + count; f++) {
+            pmm_unref_frame(frame_to_addr(f));
+        }
+        bitmap_clear_range(frame, count);
+        pmm_buddy_free(frame, order);
+    }
+    pmm_irq_restore(flags);
+
+    if (whole_block == 0) {
+        for (uint32_t f = frame; f < frame + count; f++) {
+            pmm_free_frame(frame_to_addr(f));
+        }
+    }
+}
+
+/* Get number of free frames (cached frames count as free) */
 uint32_t pmm_get_free_frames(void) {
-    return total_frames - used_frames;
+    return total_frames - used_frames + cached_frames;
 }
 
 /* Get number of used frames */
 uint32_t pmm_get_used_frames(void) {
-    return used_frames;
+    return used_frames - cached_frames;
+}
+
+/* Fill in the frame cache counters of a statistics snapshot */
+void pmm_get_cache_stats(pmm_stats_t* stats) {
+    if (stats == 0) {
+        return;
+    }
+
+    stats->cached_frames = cached_frames;
+    stats->cache_hits = cache_hits;
+    stats->cache_misses = cache_misses;
+    stats->cache_refills = cache_refills;
+    stats->cache_drains = cache_drains;
 }
 
 /* Initialize simple kernel heap for pre-paging allocations */
@@ -0,0 +1,190 @@
+/* SYNAPSE SO - PMM Buddy Allocator Implementation */
+/* Licensed under GPLv3 */
+
+#include <kernel/pmm.h>
+#include <kernel/vga.h>
+
+/* End-of-list marker for the free lists */
+#define BUDDY_NIL 0xFFFFFFFFU
+
+/* Order value for frames that do not head a free block */
+#define BUDDY_ORDER_NONE 0xFFU
+
+/* Free list links, indexed by frame number.
+   Only the first frame of a free block carries meaningful links. */
+typedef struct {
+    uint32_t next;
+    uint32_t prev;
+} buddy_link_t;
+
+static buddy_link_t* buddy_links = 0;
+static uint8_t* buddy_orders = 0;
+static uint32_t buddy_num_frames = 0;
+
+/* One doubly linked free list per order */
+static uint32_t free_heads[PMM_MAX_ORDER + 1];
+static uint32_t free_counts[PMM_MAX_ORDER + 1];
+
+/* Push a free block onto the list for its order */
+static void buddy_list_push(uint32_t frame, uint32_t order) {
+    uint32_t head = free_heads[order];
+
+    buddy_links[frame].next = head;
+    buddy_links[frame].prev = BUDDY_NIL;
+    if (head != BUDDY_NIL) {
+        buddy_links[head].prev = frame;
+    }
+
+    free_heads[order] = frame;
+    buddy_orders[frame] = (uint8_t)order;
+    free_counts[order]++;
+}
+
+/* Unlink a free block from the list for its order */
+static void buddy_list_remove(uint32_t frame, uint32_t order) {
+    uint32_t next = buddy_links[frame].next;
+    uint32_t prev = buddy_links[frame].prev;
+
+    if (prev != BUDDY_NIL) {
+        buddy_links[prev].next = next;
+    } else {
+        free_heads[order] = next;
+    }
+
+    if (next != BUDDY_NIL) {
+        buddy_links[next].prev = prev;
+    }
+
+    buddy_orders[frame] = BUDDY_ORDER_NONE;
+    free_counts[order]--;
+}
+
+/* Bytes of metadata needed for total_frames (links, then orders) */
+uint32_t pmm_buddy_metadata_size(uint32_t total_frames) {
+    return (total_frames * sizeof(buddy_link_t)) +
+           ((total_frames + 3U) & ~3U);
+}
+
+/* Follow the buddy arrays to their virtual addresses */
+void pmm_buddy_relocate(uint32_t delta) {
+    if (buddy_links != 0) {
+        buddy_links = (buddy_link_t*)((uint32_t)buddy_links + delta);
+        buddy_orders = (uint8_t*)((uint32_t)buddy_orders + delta);
+    }
+}
+
+/* Initialize buddy allocator metadata (called from pmm_init) */
+int pmm_buddy_init(uint32_t total_frames) {
+    buddy_num_frames = 0;
+
+    for (uint32_t order = 0; order <= PMM_MAX_ORDER; order++) {
+        free_heads[order] = BUDDY_NIL;
+        free_counts[order] = 0;
+    }
+
+    /* Like the refcount table, this runs before kmalloc is available. */
+    buddy_links = (buddy_link_t*)pmm_metadata_alloc(total_frames *
+                                                    sizeof(buddy_link_t));
+    buddy_orders = (uint8_t*)pmm_metadata_alloc(total_frames);
+    if ((buddy_links == 0) || (buddy_orders == 0)) {
+        vga_print("[-] Failed to allocate buddy allocator metadata\n");
+        buddy_links = 0;
+        buddy_orders = 0;
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < total_frames; i++) {
+        buddy_orders[i] = BUDDY_ORDER_NONE;
+    }
+
+    buddy_num_frames = total_frames;
+    return 0;
+}
+
+/* Check whether the buddy allocator is managing frames */
+int pmm_buddy_is_ready(void) {
+    return buddy_num_frames != 0U;
+}
+
+/* Hand a run of free frames to the buddy allocator */
+void pmm_buddy_add_range(uint32_t start_frame, uint32_t count) {
+    if (buddy_num_frames == 0U) {
+        return;
+    }
+
+    while (count > 0U) {
+        /* Largest naturally aligned block that starts here and fits */
+        uint32_t order = 0;
+        while ((order < PMM_MAX_ORDER) &&
+               ((start_frame & ((1U << (order + 1U)) - 1U)) == 0U) &&
+               ((1U << (order + 1U)) <= count)) {
+            order++;
+        }
+
+        pmm_buddy_free(start_frame, order);
+        start_frame += 1U << order;
+        count -= 1U << order;
+    }
+}
+
+/* Allocate a block of 2^order frames, returns first frame or PMM_NO_FRAME */
+uint32_t pmm_buddy_alloc(uint32_t order) {
+    if ((buddy_num_frames == 0U) || (order > PMM_MAX_ORDER)) {
+        return PMM_NO_FRAME;
+    }
+
+    /* Find the smallest order with a free block */
+    uint32_t current = order;
+    while ((current <= PMM_MAX_ORDER) && (free_heads[current] == BUDDY_NIL)) {
+        current++;
+    }
+
+    if (current > PMM_MAX_ORDER) {
+        return PMM_NO_FRAME;
+    }
+
+    uint32_t frame = free_heads[current];
+    buddy_list_remove(frame, current);
+
+    /* Split down to the requested order, returning upper halves */
+    while (current > order) {
+        current--;
+        buddy_list_push(frame + (1U << current), current);
+    }
+
+    return frame;
+}
+
+/* Return a block of 2^order frames, merging with free buddies */
+void pmm_buddy_free(uint32_t frame, uint32_t order) {
+    if ((buddy_num_frames == 0U) || (order > PMM_MAX_ORDER) ||
+        (frame >= buddy_num_frames)) {
+        return;
+    }
+
+    while (order < PMM_MAX_ORDER) {
+        uint32_t buddy = frame ^ (1U << order);
+        if ((buddy >= buddy_num_frames) || (buddy_orders[buddy] != order)) {
+            break;
+        }
+
+        buddy_list_remove(buddy, order);
+        if (buddy < frame) {
+            frame = buddy;
+        }
+        order++;
+    }
+
+    buddy_list_push(frame, order);
+}
+
+/* Number of free frames held by the buddy allocator */
+uint32_t pmm_buddy_free_frames(void) {
+    uint32_t total = 0;
+
+    for (uint32_t order = 0; order <= PMM_MAX_ORDER; order++) {
+        total += free_counts[order] << order;
+    }
+
+    return total;
+}
@@ -4,23 +4,185 @@
 #include <kernel/pmm.h>
 #include <kernel/vga.h>
 
-/* Reference count table */
-static uint16_t* frame_refcounts = 0;
+/* Reference count table: one byte per frame. Counts of
+   REFCOUNT_OVERFLOW and above live in the overflow table, and the byte
+   holds REFCOUNT_OVERFLOW as a marker. */
+static uint8_t* frame_refcounts = 0;
 static uint32_t num_frames_total = 0;
 
+/* Frames with a reference count above 1, kept up to date on 1<->2 */
+static uint32_t shared_frames = 0;
+
+#define REFCOUNT_OVERFLOW 0xFFU
+
+/* Overflow side table (open addressing, linear probing) */
+#define OVERFLOW_SLOTS 64U
+#define OVERFLOW_EMPTY 0xFFFFFFFFU
+
+typedef struct {
+    uint32_t frame;
+    uint32_t count;
+} refcount_overflow_t;
+
+static refcount_overflow_t overflow_table[OVERFLOW_SLOTS];
+static uint32_t overflow_used = 0;
+
+/* Home slot of a frame in the overflow table (top 6 bits: 64 slots) */
+static inline uint32_t overflow_hash(uint32_t frame_num) {
+    return (frame_num * 2654435761U) >> 26;
+}
+
+/* Find the overflow slot of a frame, returns OVERFLOW_SLOTS if absent */
+static uint32_t overflow_find(uint32_t frame_num) {
+    uint32_t slot = overflow_hash(frame_num);
+
+    for (uint32_t n = 0; n < OVERFLOW_SLOTS; n++) {
+        if (overflow_table[slot].frame == frame_num) {
+            return slot;
+        }
+        if (overflow_table[slot].frame == OVERFLOW_EMPTY) {
+            break;
+        }
+        slot = (slot + 1U) & (OVERFLOW_SLOTS - 1U);
+    }
+
+    return OVERFLOW_SLOTS;
+}
+
+/* Add a frame to the overflow table, returns -1 if it is full */
+static int overflow_insert(uint32_t frame_num, uint32_t count) {
+    if (overflow_used == OVERFLOW_SLOTS) {
+        return -1;
+    }
+
+    uint32_t slot = overflow_hash(frame_num);
+    while (overflow_table[slot].frame != OVERFLOW_EMPTY) {
+        slot = (slot + 1U) & (OVERFLOW_SLOTS - 1U);
+    }
+
+    overflow_table[slot].frame = frame_num;
+    overflow_table[slot].count = count;
+    overflow_used++;
+    return 0;
+}
+
+/* Remove a slot, shifting later entries of the probe run back */
+static void overflow_remove(uint32_t slot) {
+    uint32_t next = slot;
+
+    for (uint32_t n = 1; n < OVERFLOW_SLOTS; n++) {
+        next = (next + 1U) & (OVERFLOW_SLOTS - 1U);
+        if (overflow_table[next].frame == OVERFLOW_EMPTY) {
+            break;
+        }
+
+        /* Move the entry back unless its home lies in (slot, next] */
+        uint32_t home = overflow_hash(overflow_table[next].frame);
+        uint32_t dist_home = (next - home) & (OVERFLOW_SLOTS - 1U);
+        uint32_t dist_slot = (next - slot) & (OVERFLOW_SLOTS - 1U);
+        if (dist_home >= dist_slot) {
+            overflow_table[slot] = overflow_table[next];
+            slot = next;
+        }
+    }
+
+    overflow_table[slot].frame = OVERFLOW_EMPTY;
+    overflow_used--;
+}
+
+/* Increment the count of a frame known to be in range */
+static void refcount_inc(uint32_t frame_num) {
+    uint8_t count = frame_refcounts[frame_num];
+
+    if (count < REFCOUNT_OVERFLOW - 1U) {
+        frame_refcounts[frame_num] = (uint8_t)(count + 1U);
+        if (count == 1U) {
+            shared_frames++;
+        }
+        return;
+    }
+
+    if (count == REFCOUNT_OVERFLOW - 1U) {
+        /* Spill into the overflow table; if it is full the count
+           saturates and the frame is never freed */
+        overflow_insert(frame_num, REFCOUNT_OVERFLOW);
+        frame_refcounts[frame_num] = REFCOUNT_OVERFLOW;
+        return;
+    }
+
+    uint32_t slot = overflow_find(frame_num);
+    if ((slot != OVERFLOW_SLOTS) && (overflow_table[slot].count < 0xFFFFFFFFU)) {
+        overflow_table[slot].count++;
+    }
+}
+
+/* Decrement the count of a frame known to be in range, returns the new
+   count */
+static uint32_t refcount_dec(uint32_t frame_num) {
+    uint8_t count = frame_refcounts[frame_num];
+
+    if (count == 0U) {
+        return 0;
+    }
+
+    if (count < REFCOUNT_OVERFLOW) {
+        frame_refcounts[frame_num] = (uint8_t)(count - 1U);
+        if (count == 2U) {
+            shared_frames--;
+        }
+        return count - 1U;
+    }
+
+    uint32_t slot = overflow_find(frame_num);
+    if (slot == OVERFLOW_SLOTS) {
+        return REFCOUNT_OVERFLOW;  /* Saturated */
+    }
+
+    overflow_table[slot].count--;
+    if (overflow_table[slot].count < REFCOUNT_OVERFLOW) {
+        /* Back in range of the byte table */
+        frame_refcounts[frame_num] = (uint8_t)overflow_table[slot].count;
+        overflow_remove(slot);
+        return frame_refcounts[frame_num];
+    }
+
+    return overflow_table[slot].count;
+}
+
+/* Bytes of metadata needed for the refcount table */
+uint32_t pmm_refcount_metadata_size(uint32_t total_frames) {
+    return (total_frames + 3U) & ~3U;
+}
+
+/* Follow the refcount table to its virtual address */
+void pmm_refcount_relocate(uint32_t delta) {
+    if (frame_refcounts != 0) {
+        frame_refcounts = (uint8_t*)((uint32_t)frame_refcounts + delta);
+    }
+}
+
 /* Initialize reference counting (called from pmm_init) */
 void pmm_refcount_init(uint32_t total_frames) {
     num_frames_total = total_frames;
+    shared_frames = 0;
+
+    for (uint32_t i = 0; i < OVERFLOW_SLOTS; i++) {
+        overflow_table[i].frame = OVERFLOW_EMPTY;
+        overflow_table[i].count = 0;
+    }
+    overflow_used = 0;
 
-    /* Allocate refcount table using early PMM heap.
+    /* Allocate refcount table from the PMM metadata region.
        This runs before the full kernel heap (kmalloc) is initialized. */
-    frame_refcounts = (uint16_t*)pmm_kmalloc(total_frames * sizeof(uint16_t));
+    frame_refcounts = (uint8_t*)pmm_metadata_alloc(
+        pmm_refcount_metadata_size(total_frames));
     if (frame_refcounts == 0) {
         vga_print("[-] Failed to allocate reference count table\n");
         return;
     }
     
-    /* Initialize all reference counts to 0 */
+    /* Initialize all reference counts to 0. Frames reserved at boot keep
+       a count of 0; only frames handed out by the allocator are counted. */
     for (uint32_t i = 0; i < total_frames; i++) {
         frame_refcounts[i] = 0;
     }
@@ -41,10 +203,7 @@ void pmm_ref_frame(uint32_t frame_addr) {
         return;
     }
     
-    /* Increment reference count if not at maximum */
-    if (frame_refcounts[frame_num] < 0xFFFF) {
-        frame_refcounts[frame_num]++;
-    }
+    refcount_inc(frame_num);
 }
 
 /* Decrement reference count, free if reaches 0 */
@@ -58,10 +217,7 @@ void pmm_unref_frame(uint32_t frame_addr) {
         return;
     }
 
-    /* Decrement reference count if greater than 0 */
-    if (frame_refcounts[frame_num] > 0) {
-        frame_refcounts[frame_num]--;
-    }
+    refcount_dec(frame_num);
 }
 
 /* Get reference count */
@@ -75,7 +231,51 @@ uint32_t pmm_get_ref_count(uint32_t frame_addr) {
         return 0;
     }
     
-    return frame_refcounts[frame_num];
+    uint8_t count = frame_refcounts[frame_num];
+    if (count == REFCOUNT_OVERFLOW) {
+        uint32_t slot = overflow_find(frame_num);
+        if (slot != OVERFLOW_SLOTS) {
+            return overflow_table[slot].count;
+        }
+    }
+
+    return count;
+}
+
+/* Give freshly allocated frames their first reference */
+void pmm_ref_frames_bulk(const uint32_t* frames, uint32_t count) {
+    if ((frame_refcounts == 0) || (frames == 0)) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t frame_num = frames[i] / FRAME_SIZE;
+        if (frame_num < num_frames_total) {
+            refcount_inc(frame_num);
+        }
+    }
+}
+
+/* Drop one reference from each frame, keeping those that hit 0 */
+uint32_t pmm_unref_frames_bulk(uint32_t* frames, uint32_t count) {
+    if ((frame_refcounts == 0) || (frames == 0)) {
+        return 0;
+    }
+
+    uint32_t released = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t frame_num = frames[i] / FRAME_SIZE;
+        if ((frame_num >= num_frames_total) ||
+            (frame_refcounts[frame_num] == 0)) {
+            continue;
+        }
+
+        if (refcount_dec(frame_num) == 0U) {
+            frames[released++] = frames[i];
+        }
+    }
+
+    return released;
 }
 
 /* Get PMM statistics */
@@ -88,14 +288,9 @@ void pmm_get_stats(pmm_stats_t* stats) {
     stats->total_frames = pmm_get_free_frames() + pmm_get_used_frames();
     stats->used_frames = pmm_get_used_frames();
     stats->free_frames = pmm_get_free_frames();
+    pmm_get_cache_stats(stats);
+    pmm_get_zero_pool_stats(stats);
     
-    /* Count shared frames (frames with refcount > 1) */
-    stats->shared_frames = 0;
-    if (frame_refcounts != 0) {
-        for (uint32_t i = 0; i < num_frames_total; i++) {
-            if (frame_refcounts[i] > 1) {
-                stats->shared_frames++;
-            }
-        }
-    }
+    /* Frames with refcount > 1, maintained on every 1<->2 transition */
+    stats->shared_frames = shared_frames;
 }
@@ -0,0 +1,106 @@
+/* SYNAPSE SO - PMM Pre-zeroed Frame Pool */
+/* Licensed under GPLv3 */
+
+#include <kernel/pmm.h>
+#include <kernel/vmm.h>
+#include <kernel/string.h>
+
+/* Frames owned by the pool (refcount 1) whose contents are all zero */
+static uint32_t zero_pool[PMM_ZERO_POOL_SIZE];
+static uint32_t zero_pool_count;
+static uint32_t zero_hits;
+static uint32_t zero_misses;
+
+/* Zero a frame through a kmap */
+static int zero_frame(uint32_t phys_addr) {
+    uint32_t virt = vmm_kmap_atomic(phys_addr);
+    if (virt == 0) {
+        return -1;
+    }
+
+    memset((void*)virt, 0, FRAME_SIZE);
+
+    vmm_kunmap_atomic(virt);
+    return 0;
+}
+
+/* Take a zeroed frame from the pool, returns 0 if the pool is empty */
+uint32_t pmm_zero_pool_take(void) {
+    uint32_t frame = 0;
+    uint32_t flags = pmm_irq_save();
+
+    if (zero_pool_count != 0U) {
+        frame = zero_pool[--zero_pool_count];
+    }
+
+    pmm_irq_restore(flags);
+    return frame;
+}
+
+/* Allocate a zeroed frame, zeroing inline only when the pool is empty */
+uint32_t pmm_alloc_zeroed_frame(void) {
+    uint32_t frame = pmm_zero_pool_take();
+    if (frame != 0U) {
+        zero_hits++;
+        return frame;
+    }
+
+    zero_misses++;
+    frame = pmm_alloc_frame();
+    if (frame == 0U) {
+        return 0;
+    }
+
+    if (zero_frame(frame) != 0) {
+        pmm_free_frame(frame);
+        return 0;
+    }
+
+    return frame;
+}
+
+/* Zero one more frame for the pool (called from the idle loop).
+   Returns 0 if a frame was added, -1 if the pool is full or memory is
+   too low to spare one. */
+int pmm_zero_pool_refill(void) {
+    if ((zero_pool_count >= PMM_ZERO_POOL_SIZE) ||
+        (pmm_get_free_frames() <= PMM_ZERO_POOL_RESERVE)) {
+        return -1;
+    }
+
+    uint32_t frame = pmm_alloc_frame();
+    if (frame == 0U) {
+        return -1;
+    }
+
+    if (zero_frame(frame) != 0) {
+        pmm_free_frame(frame);
+        return -1;
+    }
+
+    uint32_t flags = pmm_irq_save();
+    if (zero_pool_count < PMM_ZERO_POOL_SIZE) {
+        zero_pool[zero_pool_count++] = frame;
+        frame = 0;
+    }
+    pmm_irq_restore(flags);
+
+    /* Someone else filled the pool while we were zeroing */
+    if (frame != 0U) {
+        pmm_free_frame(frame);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Fill in the zeroed pool counters of a statistics snapshot */
+void pmm_get_zero_pool_stats(pmm_stats_t* stats) {
+    if (stats == 0) {
+        return;
+    }
+
+    stats->zeroed_frames = zero_pool_count;
+    stats->zero_hits = zero_hits;
+    stats->zero_misses = zero_misses;
+}
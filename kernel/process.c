@@ -3,6 +3,7 @@
 
 #include <kernel/process.h>
 #include <kernel/gdt.h>
+#include <kernel/idt.h>
 #include <kernel/heap.h>
 #include <kernel/pmm.h>
 #include <kernel/string.h>
@@ -10,6 +11,7 @@
 #include <kernel/vmm.h>
 #include <kernel/const.h>
 #include <kernel/scheduler.h>
+#include <kernel/slab.h>
 
 #define IRQ0_VECTOR       32
 
@@ -92,16 +94,99 @@ static void process_init_kernel_thread_stack(process_t* proc,
     proc->esp = (uint32_t)sp;
 }
 
+/* Give a user process a kernel stack holding its first return to user
+   mode */
+int process_init_user_stack(process_t* proc, uint32_t entry) {
+    void* stack = kmalloc(KERNEL_STACK_SIZE);
+    if (stack == 0) {
+        return -1;
+    }
+
+    proc->kernel_stack = (uint32_t)stack;
+    uint32_t* sp = (uint32_t*)(proc->kernel_stack + KERNEL_STACK_SIZE);
+
+    /* iret frame to ring 3 (user stack pointer and segment included) */
+    sp = stack_push(sp, GDT_USER_DATA);    /* ss */
+    sp = stack_push(sp, proc->stack_end);  /* useresp */
+    sp = stack_push(sp, 0x202);            /* EFLAGS (IF=1) */
+    sp = stack_push(sp, GDT_USER_CODE);
+    sp = stack_push(sp, entry);
+
+    /* int_no + err_code (like IRQ stubs) */
+    sp = stack_push(sp, 0);
+    sp = stack_push(sp, IRQ0_VECTOR);
+
+    /* pusha frame (matches registers_t order after pusha) */
+    for (uint32_t i = 0; i < 8U; i++) {
+        sp = stack_push(sp, 0);
+    }
+
+    /* segment registers (push order in isr_common_stub: ds, es, fs, gs) */
+    sp = stack_push(sp, GDT_USER_DATA); /* ds */
+    sp = stack_push(sp, GDT_USER_DATA); /* es */
+    sp = stack_push(sp, GDT_USER_DATA); /* fs */
+    sp = stack_push(sp, GDT_USER_DATA); /* gs */
+
+    proc->eip = entry;
+    proc->esp = (uint32_t)sp;
+    return 0;
+}
+
+/* Give a forked user process a kernel stack holding a copy of the
+   parent's system call frame */
+int process_fork_user_stack(process_t* child, const process_t* parent) {
+    if (parent->kernel_stack == 0) {
+        return -1;
+    }
+
+    void* stack = kmalloc(KERNEL_STACK_SIZE);
+    if (stack == 0) {
+        return -1;
+    }
+
+    /* A trap from user mode starts at the top of the kernel stack, so
+       the parent's frame for this fork() sits right below it */
+    uint32_t offset = KERNEL_STACK_SIZE - sizeof(registers_t);
+    registers_t* frame = (registers_t*)((uint32_t)stack + offset);
+    memcpy(frame, (const void*)(parent->kernel_stack + offset),
+           sizeof(registers_t));
+    frame->eax = 0;  /* Child returns 0 from fork */
+
+    child->kernel_stack = (uint32_t)stack;
+    child->esp = (uint32_t)frame;
+    return 0;
+}
+
+/* Object cache for process control blocks */
+static kmem_cache_t* process_cache = 0;
+
 /* Initialize process management */
 void process_init(void) {
     vga_print("[+] Initializing Process Management...\n");
     process_list = 0;
     current_process = 0;
     next_pid = 1;
+
+    process_cache = kmem_cache_create("process_t", sizeof(process_t), 0, 0);
+    if (process_cache == 0) {
+        vga_print("[-] Failed to create process cache\n");
+    }
+
+    vma_init();
+}
+
+/* Allocate a process control block */
+process_t* process_alloc(void) {
+    return (process_t*)kmem_cache_alloc(process_cache);
+}
+
+/* Free a process control block */
+void process_free(process_t* proc) {
+    kmem_cache_free(process_cache, proc);
 }
 
 process_t* process_create_current(const char* name) {
-    process_t* proc = (process_t*)kmalloc(sizeof(process_t));
+    process_t* proc = process_alloc();
     if (proc == 0) {
         return 0;
     }
@@ -116,6 +201,8 @@ process_t* process_create_current(const char* name) {
     proc->heap_end = 0;
     proc->stack_start = 0;
     proc->stack_end = 0;
+    proc->vmas = 0;
+    proc->kernel_stack = 0;
 
     proc->esp = 0;
     proc->ebp = 0;
@@ -151,7 +238,7 @@ process_t* process_create_current(const char* name) {
 /* Create a new process */
 process_t* process_create(const char* name, uint32_t flags,
                           process_entry_t entry) {
-    process_t* proc = (process_t*)kmalloc(sizeof(process_t));
+    process_t* proc = process_alloc();
     if (proc == 0) {
         return 0;
     }
@@ -167,6 +254,8 @@ process_t* process_create(const char* name, uint32_t flags,
 
     proc->heap_start = 0;
     proc->heap_end = 0;
+    proc->vmas = 0;
+    proc->kernel_stack = 0;
 
     if (name != 0) {
         strncpy(proc->name, name, 31);
@@ -181,7 +270,7 @@ process_t* process_create(const char* name, uint32_t flags,
     } else {
         proc->page_dir = vmm_create_page_directory();
         if (proc->page_dir == 0) {
-            kfree(proc);
+            process_free(proc);
             return 0;
         }
     }
@@ -192,24 +281,22 @@ process_t* process_create(const char* name, uint32_t flags,
     if (flags & PROC_FLAG_KERNEL) {
         void* stack = kmalloc(stack_size);
         if (stack == 0) {
-            kfree(proc);
+            process_free(proc);
             return 0;
         }
 
         proc->stack_start = (uint32_t)stack;
         proc->stack_end = proc->stack_start + stack_size;
     } else {
-        uint32_t stack_phys = pmm_alloc_frame();
-        if (stack_phys == 0) {
-            kfree(proc);
+        /* Reserve the stack; its pages are filled in on first touch */
+        proc->stack_start = USER_STACK_TOP - stack_size;
+        proc->stack_end = USER_STACK_TOP;
+        if (vma_add(proc, proc->stack_start, proc->stack_end,
+                    VMA_READ | VMA_WRITE | VMA_STACK) != 0) {
+            vmm_destroy_page_directory(proc->page_dir);
+            process_free(proc);
             return 0;
         }
-
-        uint32_t stack_virt = 0x7FFFF000;
-        vmm_map_page(stack_virt, stack_phys,
-                     PAGE_PRESENT | PAGE_WRITE | PAGE_USER);
-        proc->stack_start = stack_virt - stack_size;
-        proc->stack_end = stack_virt;
     }
 
     proc->eip = (uint32_t)entry;
@@ -221,7 +308,9 @@ process_t* process_create(const char* name, uint32_t flags,
     if ((flags & PROC_FLAG_KERNEL) && entry != 0) {
         process_init_kernel_thread_stack(proc, entry);
     } else {
-        proc->esp = proc->stack_end;
+        /* No frame to resume from yet: the scheduler passes the process
+           over until process_init_user_stack (or the caller) builds one */
+        proc->esp = 0;
         proc->ebp = proc->stack_end;
     }
 
@@ -267,8 +356,12 @@ void process_destroy(process_t* proc) {
     if ((proc->flags & PROC_FLAG_KERNEL) && proc->stack_start != 0) {
         kfree((void*)proc->stack_start);
     }
+    if (proc->kernel_stack != 0) {
+        kfree((void*)proc->kernel_stack);
+    }
+    vma_free_all(proc);
 
-    kfree(proc);
+    process_free(proc);
 
     /* Restore interrupts after all cleanup is complete */
     if (flags & (1 << 9)) {
@@ -392,6 +485,10 @@ void process_set_name(process_t* proc, const char* name) {
 /* Idle process */
 void idle_process(void) {
     while (1) {
-        __asm__ volatile("hlt");
+        /* Use idle time to top up the pre-zeroed frame pool; only halt
+           once it is full (or memory is low) */
+        if (pmm_zero_pool_refill() != 0) {
+            __asm__ volatile("hlt");
+        }
     }
 }
@@ -2,7 +2,7 @@
 /* Licensed under GPLv3 */
 
 #include <kernel/ramfs.h>
-#include <kernel/heap.h>
+#include <kernel/slab.h>
 #include <kernel/string.h>
 #include <kernel/vga.h>
 #include <kernel/vfs.h>
@@ -25,6 +25,9 @@ typedef struct {
 static ramfs_file_t ramfs_files[RAMFS_MAX_FILES];
 static filesystem_t ramfs_fs;
 
+/* Object cache for fixed-size file buffers */
+static kmem_cache_t* ramfs_data_cache = 0;
+
 /* Find a file by name */
 static ramfs_file_t* ramfs_find_file(const char* name) {
     if (name == 0) {
@@ -73,7 +76,7 @@ static uint32_t ramfs_open(const char* path, int flags) {
     /* Initialize file */
     strncpy(file->name, path, RAMFS_MAX_NAME - 1);
     file->name[RAMFS_MAX_NAME - 1] = '\0';
-    file->data = (uint8_t*)kmalloc(RAMFS_MAX_SIZE);
+    file->data = (uint8_t*)kmem_cache_alloc(ramfs_data_cache);
     if (file->data == 0) {
         vga_print("[-] ramfs: Failed to allocate file data\n");
         return 0;
@@ -188,6 +191,12 @@ int ramfs_init(void) {
         ramfs_files[i].in_use = 0;
     }
 
+    ramfs_data_cache = kmem_cache_create("ramfs_data", RAMFS_MAX_SIZE, 0, 0);
+    if (ramfs_data_cache == 0) {
+        vga_print("[-] ramfs: Failed to create file buffer cache\n");
+        return -1;
+    }
+
     /* Set up filesystem structure */
     strcpy(ramfs_fs.name, "ramfs");
     ramfs_fs.next = 0;
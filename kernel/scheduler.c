@@ -11,6 +11,8 @@
 #include <kernel/process.h>
 #include <kernel/vga.h>
 #include <kernel/vmm.h>
+#include <kernel/gdt.h>
+#include <kernel/const.h>
 
 /* Scheduler quantum */
 static uint32_t quantum = DEFAULT_QUANTUM;
@@ -179,6 +181,12 @@ registers_t* scheduler_tick(registers_t* regs) {
     scheduler_count_switch();
     scheduler_update_stats(0);  /* 0 = not idle (we're switching to a process) */
 
+    /* Interrupts taken in user mode land on the process's own kernel
+       stack, where its frame is saved */
+    if (next->kernel_stack != 0) {
+        gdt_set_kernel_stack(next->kernel_stack + KERNEL_STACK_SIZE);
+    }
+
     vmm_switch_page_directory(next->page_dir);
     process_set_current(next);
     return (registers_t*)next->esp;
@@ -95,3 +95,34 @@ void serial_write(const char* str) {
         serial_write_char(str[i]);
     }
 }
+
+void serial_write_dec(uint32_t num) {
+    char buffer[11];
+    int i = 0;
+
+    /* Convert number to string (reversed) */
+    do {
+        buffer[i++] = (char)('0' + (num % 10U));
+        num /= 10U;
+    } while (num > 0U);
+
+    while (i > 0) {
+        serial_write_char(buffer[--i]);
+    }
+}
+
+void serial_write_hex(uint32_t num) {
+    static const char hex_chars[] = "0123456789ABCDEF";
+    char buffer[11];
+
+    buffer[0] = '0';
+    buffer[1] = 'x';
+
+    for (int i = 0; i < 8; i++) {
+        buffer[9 - i] = hex_chars[num & 0xFU];
+        num >>= 4;
+    }
+
+    buffer[10] = '\0';
+    serial_write(buffer);
+}
@@ -0,0 +1,391 @@
+/* SYNAPSE SO - Slab Allocator Implementation */
+/* Licensed under GPLv3 */
+
+#include <kernel/slab.h>
+#include <kernel/pmm.h>
+#include <kernel/vmm.h>
+#include <kernel/vga.h>
+#include <kernel/string.h>
+
+/* Slabs are mapped at naturally aligned addresses in the slab region,
+   so the slab of an object is found by masking its address. Their frames
+   come from anywhere in physical memory. */
+
+/* Cache of cache descriptors, bootstrapped statically */
+static kmem_cache_t cache_cache;
+
+/* Pages of the slab region in use */
+static uint32_t slab_va_map[SLAB_VIRT_PAGES / 32];
+
+/* All caches, for statistics */
+static kmem_cache_t* cache_list = 0;
+
+static inline uint32_t align_up(uint32_t value, uint32_t align) {
+    return (value + align - 1U) & ~(align - 1U);
+}
+
+static inline uint32_t slab_bytes(const kmem_cache_t* cache) {
+    return FRAME_SIZE << cache->slab_order;
+}
+
+/* Disable interrupts, returning the previous EFLAGS */
+static inline uint32_t slab_lock(void) {
+    uint32_t flags;
+    __asm__ volatile("pushf; pop %0; cli" : "=r"(flags) :: "memory");
+    return flags;
+}
+
+static inline void slab_unlock(uint32_t flags) {
+    if (flags & (1 << 9)) {
+        __asm__ volatile("sti" ::: "memory");
+    }
+}
+
+/* Free-list link of an object */
+static inline void** obj_link(const kmem_cache_t* cache, void* obj) {
+    return (void**)((uint8_t*)obj + cache->link_offset);
+}
+
+/* Unlink a slab from one of a cache's lists */
+static void slab_list_remove(kmem_slab_t** head, kmem_slab_t* slab) {
+    if (slab->prev != 0) {
+        slab->prev->next = slab->next;
+    } else {
+        *head = slab->next;
+    }
+    if (slab->next != 0) {
+        slab->next->prev = slab->prev;
+    }
+    slab->next = 0;
+    slab->prev = 0;
+}
+
+/* Push a slab onto one of a cache's lists */
+static void slab_list_push(kmem_slab_t** head, kmem_slab_t* slab) {
+    slab->prev = 0;
+    slab->next = *head;
+    if (*head != 0) {
+        (*head)->prev = slab;
+    }
+    *head = slab;
+}
+
+/* Work out slab order, objects per slab and coloring range */
+static void cache_layout(kmem_cache_t* cache) {
+    uint32_t header = align_up(sizeof(kmem_slab_t), cache->align);
+
+    cache->slab_order = 0;
+    for (;;) {
+        uint32_t space = slab_bytes(cache) - header;
+        cache->objects_per_slab = space / cache->object_size;
+        if ((cache->objects_per_slab >= SLAB_MIN_OBJECTS) ||
+            (cache->slab_order == SLAB_MAX_ORDER)) {
+            break;
+        }
+        cache->slab_order++;
+    }
+
+    /* Leftover space shifts each new slab's objects by a different
+       multiple of the alignment, spreading them across cache lines */
+    cache->color_max = slab_bytes(cache) - header -
+                       cache->objects_per_slab * cache->object_size;
+    cache->color_next = 0;
+}
+
+/* Fill in a cache descriptor */
+static void cache_setup(kmem_cache_t* cache, const char* name, uint32_t size,
+                        uint32_t align, kmem_ctor_t ctor) {
+    if (align < SLAB_ALIGN) {
+        align = SLAB_ALIGN;
+    }
+    if (size < sizeof(void*)) {
+        size = sizeof(void*);
+    }
+
+    strncpy(cache->name, name, sizeof(cache->name) - 1U);
+    cache->name[sizeof(cache->name) - 1U] = '\0';
+
+    /* Free objects are linked through their first word, unless a
+       constructor has set them up; then the link goes after the object
+       so constructed state survives a free/alloc cycle */
+    if (ctor != 0) {
+        cache->link_offset = align_up(size, sizeof(void*));
+        cache->object_size = align_up(cache->link_offset + sizeof(void*),
+                                      align);
+    } else {
+        cache->link_offset = 0;
+        cache->object_size = align_up(size, align);
+    }
+    cache->align = align;
+    cache->ctor = ctor;
+    cache->partial = 0;
+    cache->full = 0;
+    cache->empty = 0;
+    cache->total_slabs = 0;
+    cache->active_objects = 0;
+
+    cache_layout(cache);
+
+    cache->next = cache_list;
+    cache_list = cache;
+}
+
+/* Mark a naturally aligned run of 2^order pages of the slab region */
+static void slab_va_mark(uint32_t page, uint32_t order, int used) {
+    for (uint32_t i = page; i < page + (1U << order); i++) {
+        if (used) {
+            slab_va_map[i / 32] |= 1U << (i % 32);
+        } else {
+            slab_va_map[i / 32] &= ~(1U << (i % 32));
+        }
+    }
+}
+
+/* Find a free, naturally aligned run of 2^order pages in the slab region
+   (returns 0 if it is full) */
+static uint32_t slab_va_alloc(uint32_t order) {
+    uint32_t count = 1U << order;
+
+    for (uint32_t page = 0; page < SLAB_VIRT_PAGES; page += count) {
+        uint32_t i = page;
+        while ((i < page + count) &&
+               ((slab_va_map[i / 32] & (1U << (i % 32))) == 0U)) {
+            i++;
+        }
+        if (i == page + count) {
+            slab_va_mark(page, order, 1);
+            return SLAB_VIRT_BASE + page * PAGE_SIZE;
+        }
+    }
+
+    return 0;
+}
+
+/* Allocate and carve a new slab for a cache */
+static kmem_slab_t* slab_create(kmem_cache_t* cache) {
+    uint32_t count = 1U << cache->slab_order;
+    uint32_t frames[1U << SLAB_MAX_ORDER];
+
+    uint32_t virt = slab_va_alloc(cache->slab_order);
+    if (virt == 0U) {
+        return 0;
+    }
+    if (pmm_alloc_frames_bulk(frames, count) != 0) {
+        slab_va_mark((virt - SLAB_VIRT_BASE) / PAGE_SIZE, cache->slab_order, 0);
+        return 0;
+    }
+    vmm_map_range(virt, frames, count, PAGE_PRESENT | PAGE_WRITE | PAGE_GLOBAL);
+
+    kmem_slab_t* slab = (kmem_slab_t*)virt;
+    slab->next = 0;
+    slab->prev = 0;
+    slab->cache = cache;
+    slab->in_use = 0;
+    slab->free_list = 0;
+
+    uint32_t color = cache->color_next;
+    cache->color_next += cache->align;
+    if (cache->color_next > cache->color_max) {
+        cache->color_next = 0;
+    }
+
+    uint8_t* first = (uint8_t*)slab +
+                     align_up(sizeof(kmem_slab_t), cache->align) + color;
+
+    /* Build the free list back to front so objects are handed out in
+       address order */
+    for (uint32_t i = cache->objects_per_slab; i > 0U; i--) {
+        void* obj = first + (i - 1U) * cache->object_size;
+        if (cache->ctor != 0) {
+            cache->ctor(obj);
+        }
+        *obj_link(cache, obj) = slab->free_list;
+        slab->free_list = obj;
+    }
+
+    cache->total_slabs++;
+    return slab;
+}
+
+/* Give a slab's frames back to the PMM and its pages to the region */
+static void slab_release(kmem_cache_t* cache, kmem_slab_t* slab) {
+    cache->total_slabs--;
+    vmm_unmap_range((uint32_t)slab, 1U << cache->slab_order);
+    slab_va_mark(((uint32_t)slab - SLAB_VIRT_BASE) / PAGE_SIZE,
+                 cache->slab_order, 0);
+}
+
+/* Initialize the slab allocator */
+void slab_init(void) {
+    vga_print("[+] Initializing Slab Allocator...\n");
+
+    cache_list = 0;
+    cache_setup(&cache_cache, "kmem_cache", sizeof(kmem_cache_t), 0, 0);
+}
+
+/* Create an object cache */
+kmem_cache_t* kmem_cache_create(const char* name, uint32_t size,
+                                uint32_t align, kmem_ctor_t ctor) {
+    if ((name == 0) || (size == 0U)) {
+        return 0;
+    }
+
+    /* Alignment must be a power of two */
+    if ((align & (align - 1U)) != 0U) {
+        vga_print("[-] slab: Alignment must be a power of two\n");
+        return 0;
+    }
+
+    kmem_cache_t* cache = (kmem_cache_t*)kmem_cache_alloc(&cache_cache);
+    if (cache == 0) {
+        return 0;
+    }
+
+    uint32_t flags = slab_lock();
+    cache_setup(cache, name, size, align, ctor);
+    slab_unlock(flags);
+
+    if (cache->objects_per_slab == 0U) {
+        vga_print("[-] slab: Object too large for a slab: ");
+        vga_print(name);
+        vga_print("\n");
+        kmem_cache_destroy(cache);
+        return 0;
+    }
+
+    return cache;
+}
+
+/* Destroy an object cache */
+int kmem_cache_destroy(kmem_cache_t* cache) {
+    if ((cache == 0) || (cache == &cache_cache)) {
+        return -1;
+    }
+
+    uint32_t flags = slab_lock();
+
+    if ((cache->partial != 0) || (cache->full != 0)) {
+        slab_unlock(flags);
+        vga_print("[-] slab: Cache still has objects: ");
+        vga_print(cache->name);
+        vga_print("\n");
+        return -1;
+    }
+
+    if (cache->empty != 0) {
+        slab_release(cache, cache->empty);
+        cache->empty = 0;
+    }
+
+    kmem_cache_t** link = &cache_list;
+    while (*link != 0) {
+        if (*link == cache) {
+            *link = cache->next;
+            break;
+        }
+        link = &(*link)->next;
+    }
+
+    slab_unlock(flags);
+
+    kmem_cache_free(&cache_cache, cache);
+    return 0;
+}
+
+/* Allocate an object */
+void* kmem_cache_alloc(kmem_cache_t* cache) {
+    if (cache == 0) {
+        return 0;
+    }
+
+    uint32_t flags = slab_lock();
+
+    kmem_slab_t* slab = cache->partial;
+    if (slab == 0) {
+        slab = cache->empty;
+        if (slab != 0) {
+            cache->empty = 0;
+        } else {
+            slab = slab_create(cache);
+            if (slab == 0) {
+                slab_unlock(flags);
+                vga_print("[-] slab: Out of memory for cache ");
+                vga_print(cache->name);
+                vga_print("\n");
+                return 0;
+            }
+        }
+        slab_list_push(&cache->partial, slab);
+    }
+
+    void* obj = slab->free_list;
+    slab->free_list = *obj_link(cache, obj);
+    slab->in_use++;
+    cache->active_objects++;
+
+    if (slab->free_list == 0) {
+        slab_list_remove(&cache->partial, slab);
+        slab_list_push(&cache->full, slab);
+    }
+
+    slab_unlock(flags);
+    return obj;
+}
+
+/* Return an object to its cache */
+void kmem_cache_free(kmem_cache_t* cache, void* obj) {
+    if ((cache == 0) || (obj == 0)) {
+        return;
+    }
+
+    kmem_slab_t* slab =
+        (kmem_slab_t*)((uint32_t)obj & ~(slab_bytes(cache) - 1U));
+    if ((slab->cache != cache) || (slab->in_use == 0U)) {
+        vga_print("[-] slab: Invalid free to cache ");
+        vga_print(cache->name);
+        vga_print("\n");
+        return;
+    }
+
+    uint32_t flags = slab_lock();
+
+    int was_full = (slab->free_list == 0);
+    *obj_link(cache, obj) = slab->free_list;
+    slab->free_list = obj;
+    slab->in_use--;
+    cache->active_objects--;
+
+    if (was_full) {
+        slab_list_remove(&cache->full, slab);
+        slab_list_push(&cache->partial, slab);
+    }
+
+    if (slab->in_use == 0U) {
+        /* Keep one empty slab around; release any other */
+        slab_list_remove(&cache->partial, slab);
+        if (cache->empty == 0) {
+            cache->empty = slab;
+        } else {
+            slab_release(cache, slab);
+        }
+    }
+
+    slab_unlock(flags);
+}
+
+/* Print per-cache statistics */
+void slab_print_stats(void) {
+    for (kmem_cache_t* cache = cache_list; cache != 0; cache = cache->next) {
+        vga_print("  ");
+        vga_print(cache->name);
+        vga_print(": ");
+        vga_print_dec(cache->active_objects);
+        vga_print(" objects of ");
+        vga_print_dec(cache->object_size);
+        vga_print(" bytes, ");
+        vga_print_dec(cache->total_slabs);
+        vga_print(" slabs of ");
+        vga_print_dec(slab_bytes(cache) / 1024U);
+        vga_print(" KB\n");
+    }
+}
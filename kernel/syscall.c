@@ -12,6 +12,11 @@
 #include <kernel/wait.h>
 #include <kernel/vfs.h>
 #include <kernel/keyboard.h>
+#include <kernel/uaccess.h>
+#include <kernel/errno.h>
+
+/* Bytes moved per user copy in sys_read/sys_write */
+#define SYSCALL_COPY_CHUNK 256U
 
 /* System call table */
 static syscall_func_t syscall_table[NUM_SYSCALLS];
@@ -98,6 +103,23 @@ static int sys_lseek_wrapper(uint32_t arg1, uint32_t arg2, uint32_t arg3,
     return sys_lseek((int)arg1, (int)arg2, (int)arg3);
 }
 
+static int sys_brk_wrapper(uint32_t arg1, uint32_t arg2, uint32_t arg3,
+                           uint32_t arg4, uint32_t arg5) {
+    (void)arg2;
+    (void)arg3;
+    (void)arg4;
+    (void)arg5;
+    return sys_brk(arg1);
+}
+
+static int sys_spawn_wrapper(uint32_t arg1, uint32_t arg2, uint32_t arg3,
+                             uint32_t arg4, uint32_t arg5) {
+    (void)arg3;
+    (void)arg4;
+    (void)arg5;
+    return sys_spawn(arg1, arg2);
+}
+
 /* Initialize system call interface */
 void syscall_init(void) {
     vga_print("[+] Initializing System Call Interface...\n");
@@ -118,6 +140,8 @@ void syscall_init(void) {
     syscall_register(SYS_WAIT, sys_wait_wrapper);
     syscall_register(SYS_GETPID, sys_getpid_wrapper);
     syscall_register(SYS_LSEEK, sys_lseek_wrapper);
+    syscall_register(SYS_BRK, sys_brk_wrapper);
+    syscall_register(SYS_SPAWN, sys_spawn_wrapper);
 
     vga_print("    System calls registered\n");
 }
@@ -213,56 +237,26 @@ int sys_write(uint32_t fd, uint32_t buffer, uint32_t count) {
         count = 4096U;
     }
 
-    /* Access user buffer safely using temporary mappings */
+    /* Copy the user buffer in a chunk at a time */
+    char chunk[SYSCALL_COPY_CHUNK];
     uint32_t bytes_written = 0;
-    uint32_t user_addr = buffer;
-    
+
     while (bytes_written < count) {
-        /* Get physical address of user page */
-        uint32_t user_page = user_addr & 0xFFFFF000;
-        uint32_t page_offset = user_addr & 0xFFF;
-        
-        /* Get physical address (this validates the page is mapped) */
-        uint32_t phys_addr = vmm_get_phys_addr(user_page);
-        if (phys_addr == 0) {
-            /* Page not mapped - invalid pointer */
-            return bytes_written > 0 ? (int)bytes_written : -1;
-        }
-        
-        /* Allocate temporary mapping slot */
-        int slot = vmm_alloc_temp_slot();
-        if (slot < 0) {
-            /* No temporary slots available */
-            return bytes_written > 0 ? (int)bytes_written : -1;
+        uint32_t n = count - bytes_written;
+        if (n > SYSCALL_COPY_CHUNK) {
+            n = SYSCALL_COPY_CHUNK;
         }
-        
-        /* Map user page temporarily to kernel space */
-        uint32_t temp_virt = vmm_map_temp_page(phys_addr, slot);
-        if (temp_virt == 0) {
-            vmm_free_temp_slot(slot);
-            return bytes_written > 0 ? (int)bytes_written : -1;
-        }
-        
-        /* Calculate how many bytes we can read from this page */
-        uint32_t bytes_in_page = PAGE_SIZE - page_offset;
-        uint32_t bytes_to_write = count - bytes_written;
-        if (bytes_to_write > bytes_in_page) {
-            bytes_to_write = bytes_in_page;
+
+        if (copy_from_user(chunk, (const void*)(buffer + bytes_written),
+                           n) != 0) {
+            return bytes_written > 0 ? (int)bytes_written : -EFAULT;
         }
-        
-        /* Write characters from mapped page */
-        char* mapped_buf = (char*)(temp_virt + page_offset);
-        for (uint32_t i = 0; i < bytes_to_write; i++) {
-            vga_put_char(mapped_buf[i]);
+
+        for (uint32_t i = 0; i < n; i++) {
+            vga_put_char(chunk[i]);
         }
-        
-        /* Cleanup temporary mapping */
-        vmm_unmap_temp_page(slot);
-        vmm_free_temp_slot(slot);
-        
-        /* Advance to next page */
-        bytes_written += bytes_to_write;
-        user_addr += bytes_to_write;
+
+        bytes_written += n;
     }
 
     return (int)bytes_written;
@@ -288,58 +282,37 @@ int sys_read(uint32_t fd, uint32_t buffer, uint32_t count) {
         return -1;
     }
 
+    /* Collect keystrokes a chunk at a time and copy each out at once */
+    char chunk[SYSCALL_COPY_CHUNK];
     uint32_t bytes_read = 0U;
-    uint32_t user_addr = buffer;
 
     while (bytes_read < count) {
-        if (keyboard_has_char() == 0) {
-            break;
-        }
-
-        uint32_t user_page = user_addr & 0xFFFFF000U;
-        uint32_t page_offset = user_addr & 0xFFFU;
-
-        uint32_t phys_addr = vmm_get_phys_addr(user_page);
-        if (phys_addr == 0U) {
-            return (bytes_read > 0U) ? (int)bytes_read : -1;
+        uint32_t want = count - bytes_read;
+        if (want > SYSCALL_COPY_CHUNK) {
+            want = SYSCALL_COPY_CHUNK;
         }
 
-        int slot = vmm_alloc_temp_slot();
-        if (slot < 0) {
-            return (bytes_read > 0U) ? (int)bytes_read : -1;
-        }
-
-        uint32_t temp_virt = vmm_map_temp_page(phys_addr, slot);
-        if (temp_virt == 0U) {
-            vmm_free_temp_slot(slot);
-            return (bytes_read > 0U) ? (int)bytes_read : -1;
-        }
-
-        uint32_t bytes_in_page = PAGE_SIZE - page_offset;
-        uint32_t bytes_to_copy = count - bytes_read;
-        if (bytes_to_copy > bytes_in_page) {
-            bytes_to_copy = bytes_in_page;
-        }
-
-        char* mapped_buf = (char*)(temp_virt + page_offset);
-        for (uint32_t i = 0U; (i < bytes_to_copy) && (bytes_read < count);
-             i++) {
-            if (keyboard_has_char() == 0) {
-                break;
-            }
-
+        uint32_t n = 0U;
+        while ((n < want) && (keyboard_has_char() != 0)) {
             char c = keyboard_get_char();
             if (c == 0) {
                 break;
             }
+            chunk[n++] = c;
+        }
+
+        if (n == 0U) {
+            break;
+        }
 
-            mapped_buf[i] = c;
-            bytes_read++;
-            user_addr++;
+        if (copy_to_user((void*)(buffer + bytes_read), chunk, n) != 0) {
+            return (bytes_read > 0U) ? (int)bytes_read : -EFAULT;
         }
 
-        vmm_unmap_temp_page(slot);
-        vmm_free_temp_slot(slot);
+        bytes_read += n;
+        if (n < want) {
+            break;
+        }
     }
 
     return (int)bytes_read;
@@ -352,11 +325,19 @@ int sys_open(uint32_t filename, uint32_t flags, uint32_t mode) {
         return -1;
     }
 
-    const char* path = (const char*)filename;
-    if (path == 0) {
+    if (filename == 0) {
         return -1;
     }
 
+    char path[VFS_MAX_PATH];
+    int len = strncpy_from_user(path, (const char*)filename, sizeof(path));
+    if (len < 0) {
+        return len;
+    }
+    if ((uint32_t)len == sizeof(path)) {
+        return -1;  /* Path too long */
+    }
+
     return vfs_open(path, flags, mode);
 }
 
@@ -383,6 +364,19 @@ int sys_exec(uint32_t path, uint32_t argv) {
     return do_exec(prog_path, argv_ptr);
 }
 
+/* Start a program in a new process (fork + exec without the clone) */
+int sys_spawn(uint32_t path, uint32_t argv) {
+    /* Validate pointer is in user space */
+    if (path >= 0xC0000000U) {
+        return -1;
+    }
+
+    const char* prog_path = (const char*)path;
+    char* const* argv_ptr = (char* const*)argv;
+
+    return (int)do_spawn(prog_path, argv_ptr);
+}
+
 /* Wait for a process to exit */
 int sys_wait(uint32_t pid, uint32_t status) {
     /* Validate status pointer is in user space */
@@ -410,3 +404,18 @@ int sys_getpid(void) {
 int sys_lseek(int fd, int offset, int whence) {
     return vfs_lseek(fd, offset, whence);
 }
+
+/* Move the program break. Returns the new break, or the current one if
+   addr is 0 or the heap cannot be moved there (as Linux brk does). */
+int sys_brk(uint32_t addr) {
+    process_t* current = process_get_current();
+    if (current == 0) {
+        return -1;
+    }
+
+    if (addr != 0U) {
+        vma_brk(current, addr);
+    }
+
+    return (int)current->heap_end;
+}
@@ -4,6 +4,9 @@
 #include <kernel/sysinfo.h>
 #include <kernel/pmm.h>
 #include <kernel/vmm.h>
+#include <kernel/slab.h>
+#include <kernel/image.h>
+#include <kernel/heap.h>
 #include <kernel/scheduler.h>
 #include <kernel/process.h>
 #include <kernel/timer.h>
@@ -172,6 +175,22 @@ void sysinfo_print_memory(void) {
     vga_print("  Shared frames: ");
     vga_print_dec(pmm.shared_frames);
     vga_print("\n");
+    vga_print("  Cached frames: ");
+    vga_print_dec(pmm.cached_frames);
+    vga_print(" (hits: ");
+    vga_print_dec(pmm.cache_hits);
+    vga_print(", misses: ");
+    vga_print_dec(pmm.cache_misses);
+    vga_print(", refills: ");
+    vga_print_dec(pmm.cache_refills);
+    vga_print(")\n");
+    vga_print("  Zeroed pool: ");
+    vga_print_dec(pmm.zeroed_frames);
+    vga_print(" (hits: ");
+    vga_print_dec(pmm.zero_hits);
+    vga_print(", misses: ");
+    vga_print_dec(pmm.zero_misses);
+    vga_print(")\n");
     
     uint32_t pmm_usage = (pmm.used_frames * 100) / pmm.total_frames;
     vga_print("  Usage: ");
@@ -196,6 +215,51 @@ void sysinfo_print_memory(void) {
     vga_print("  Shared pages: ");
     vga_print_dec(vmm.shared_pages);
     vga_print("\n");
+    vga_print("  Shared tables: ");
+    vga_print_dec(vmm.shared_tables);
+    vga_print("\n");
+    vga_print("  COW faults:   ");
+    vga_print_dec(vmm.cow_copies);
+    vga_print(" copied, ");
+    vga_print_dec(vmm.cow_reuses);
+    vga_print(" reused\n");
+
+    vga_set_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
+    vga_print("\nKernel Heap:\n");
+    vga_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    vga_print("  Mapped: ");
+    vga_print_dec(heap_get_mapped_size() / 1024);
+    vga_print(" KB (peak: ");
+    vga_print_dec(heap_get_peak_size() / 1024);
+    vga_print(" KB)\n");
+    vga_print("  Used:   ");
+    vga_print_dec(heap_get_used_size() / 1024);
+    vga_print(" KB\n");
+    vga_print("  Free:   ");
+    vga_print_dec(heap_get_free_size() / 1024);
+    vga_print(" KB\n");
+
+    vga_set_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
+    vga_print("\nSlab Caches:\n");
+    vga_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    slab_print_stats();
+
+    image_stats_t images;
+    image_get_stats(&images);
+
+    vga_set_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK);
+    vga_print("\nProgram Images:\n");
+    vga_set_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
+    vga_print("  Open images:  ");
+    vga_print_dec(images.images);
+    vga_print("\n");
+    vga_print("  Cached pages: ");
+    vga_print_dec(images.cached_pages);
+    vga_print(" (");
+    vga_print_dec(images.hits);
+    vga_print(" hits, ");
+    vga_print_dec(images.fills);
+    vga_print(" fills)\n");
 }
 
 /* Print process list */
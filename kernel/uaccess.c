@@ -0,0 +1,123 @@
+/* SYNAPSE SO - User Memory Access Implementation */
+/* Licensed under GPLv3 */
+
+#include <kernel/uaccess.h>
+#include <kernel/errno.h>
+
+/* Exception table entry: an instruction that may fault on a user
+   address, and where to resume if it does */
+typedef struct {
+    uint32_t insn;
+    uint32_t fixup;
+} ex_table_entry_t;
+
+/* Bounds of the __ex_table section (set by the linker script) */
+extern const ex_table_entry_t __start___ex_table[];
+extern const ex_table_entry_t __stop___ex_table[];
+
+/* Check that [addr, addr + size) lies in user space. Kernel-mode copies
+   ignore the U/S bit, so the kernel's own low mappings must be refused
+   here rather than left to fault. */
+int uaccess_ok(uint32_t addr, uint32_t size) {
+    return (addr >= USER_SPACE_START) && (addr < USER_SPACE_END) &&
+           (size <= USER_SPACE_END - addr);
+}
+
+/* Copy with rep movsb; a fault leaves the remaining count in ECX and
+   resumes past the copy. Returns the number of bytes not copied. */
+static inline uint32_t uaccess_copy(void* dst, const void* src, uint32_t n) {
+    uint32_t d0;
+    uint32_t d1;
+
+    __asm__ volatile(
+        "1: rep movsb\n"
+        "2:\n"
+        ".section __ex_table, \"a\"\n"
+        "    .align 4\n"
+        "    .long 1b, 2b\n"
+        ".previous\n"
+        : "+c"(n), "=&D"(d0), "=&S"(d1)
+        : "1"(dst), "2"(src)
+        : "memory");
+
+    return n;
+}
+
+/* Copy n bytes to user space */
+int copy_to_user(void* user_dst, const void* src, uint32_t n) {
+    if (!uaccess_ok((uint32_t)user_dst, n)) {
+        return -EFAULT;
+    }
+
+    return (uaccess_copy(user_dst, src, n) == 0) ? 0 : -EFAULT;
+}
+
+/* Copy n bytes from user space */
+int copy_from_user(void* dst, const void* user_src, uint32_t n) {
+    if (!uaccess_ok((uint32_t)user_src, n)) {
+        return -EFAULT;
+    }
+
+    return (uaccess_copy(dst, user_src, n) == 0) ? 0 : -EFAULT;
+}
+
+/* Copy a NUL-terminated string from user space */
+int strncpy_from_user(char* dst, const char* user_src, uint32_t n) {
+    /* Only read as far as user space goes; a string running into the
+       kernel half faults like any other bad pointer */
+    uint32_t limit = n;
+    if ((uint32_t)user_src >= USER_SPACE_END) {
+        return -EFAULT;
+    }
+    if (limit > USER_SPACE_END - (uint32_t)user_src) {
+        limit = USER_SPACE_END - (uint32_t)user_src;
+    }
+
+    int len = 0;
+    uint32_t d0;
+    uint32_t d1;
+    uint32_t d2;
+
+    __asm__ volatile(
+        "    testl %[cnt], %[cnt]\n"
+        "    jz 3f\n"
+        "1:  lodsb\n"
+        "    stosb\n"
+        "    testb %%al, %%al\n"
+        "    jz 3f\n"
+        "    incl %[len]\n"
+        "    decl %[cnt]\n"
+        "    jnz 1b\n"
+        "3:\n"
+        ".section .text.fixup, \"ax\"\n"
+        "4:  movl %[efault], %[len]\n"
+        "    jmp 3b\n"
+        ".previous\n"
+        ".section __ex_table, \"a\"\n"
+        "    .align 4\n"
+        "    .long 1b, 4b\n"
+        ".previous\n"
+        : [len] "+r"(len), [cnt] "=&c"(d0), "=&D"(d1), "=&S"(d2)
+        : "1"(limit), "2"(dst), "3"(user_src), [efault] "i"(-EFAULT)
+        : "eax", "memory");
+
+    /* Ran out of user space before n bytes and without a NUL */
+    if ((len >= 0) && ((uint32_t)len == limit) && (limit < n)) {
+        return -EFAULT;
+    }
+
+    return len;
+}
+
+/* Point a faulting kernel context at its fixup */
+int uaccess_fixup(registers_t* regs) {
+    for (const ex_table_entry_t* entry = __start___ex_table;
+         entry < __stop___ex_table; entry++) {
+        if (entry->insn == regs->eip) {
+            regs->eip = entry->fixup;
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,302 @@
+/* SYNAPSE SO - Virtual Memory Area Implementation */
+/* Licensed under GPLv3 */
+
+#include <kernel/vma.h>
+#include <kernel/image.h>
+#include <kernel/process.h>
+#include <kernel/vmm.h>
+#include <kernel/pmm.h>
+#include <kernel/slab.h>
+#include <kernel/vga.h>
+#include <kernel/string.h>
+#include <kernel/uaccess.h>
+
+/* Object cache for regions */
+static kmem_cache_t* vma_cache = 0;
+
+static inline uint32_t page_down(uint32_t addr) {
+    return addr & 0xFFFFF000U;
+}
+
+static inline uint32_t page_up(uint32_t addr) {
+    return (addr + 0xFFFU) & 0xFFFFF000U;
+}
+
+/* Create the VMA object cache */
+void vma_init(void) {
+    vma_cache = kmem_cache_create("vma_t", sizeof(vma_t), 0, 0);
+    if (vma_cache == 0) {
+        vga_print("[-] Failed to create VMA cache\n");
+    }
+}
+
+/* Check whether [start, end) overlaps any region of a process */
+static int vma_overlaps(process_t* proc, uint32_t start, uint32_t end) {
+    for (vma_t* vma = proc->vmas; vma != 0; vma = vma->next) {
+        if ((start < vma->end) && (vma->start < end)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Insert an anonymous region into a process's list */
+static vma_t* vma_insert(process_t* proc, uint32_t start, uint32_t end,
+                         uint32_t flags) {
+    start = page_down(start);
+    end = page_up(end);
+
+    /* The first 4MB is the kernel's, shared by every address space */
+    if ((start >= end) || (start < USER_SPACE_START) ||
+        (end > USER_SPACE_END)) {
+        vga_print("[-] vma: Invalid region\n");
+        return 0;
+    }
+
+    if (vma_overlaps(proc, start, end)) {
+        vga_print("[-] vma: Region overlaps an existing one\n");
+        return 0;
+    }
+
+    vma_t* vma = (vma_t*)kmem_cache_alloc(vma_cache);
+    if (vma == 0) {
+        return 0;
+    }
+
+    vma->start = start;
+    vma->end = end;
+    vma->flags = flags;
+    vma->image = 0;
+    vma->offset = 0;
+    vma->file_start = start;
+    vma->file_end = start;
+
+    /* Keep the list in address order */
+    vma_t** link = &proc->vmas;
+    while ((*link != 0) && ((*link)->start < start)) {
+        link = &(*link)->next;
+    }
+    vma->next = *link;
+    *link = vma;
+
+    return vma;
+}
+
+/* Register a region with a process */
+int vma_add(process_t* proc, uint32_t start, uint32_t end, uint32_t flags) {
+    return (vma_insert(proc, start, end, flags) != 0) ? 0 : -1;
+}
+
+/* Register a region backed by part of an image */
+int vma_add_file(process_t* proc, uint32_t vaddr, uint32_t end,
+                 uint32_t flags, image_t* image, uint32_t offset,
+                 uint32_t filesz) {
+    if ((image == 0) || (end < vaddr) || (filesz > end - vaddr) ||
+        (offset > image->size) || (filesz > image->size - offset)) {
+        vga_print("[-] vma: Invalid file region\n");
+        return -1;
+    }
+
+    vma_t* vma = vma_insert(proc, vaddr, end, flags);
+    if (vma == 0) {
+        return -1;
+    }
+
+    image_get(image);
+    vma->image = image;
+    vma->offset = offset;
+    vma->file_start = vaddr;
+    vma->file_end = vaddr + filesz;
+    return 0;
+}
+
+/* Region containing addr */
+vma_t* vma_find(process_t* proc, uint32_t addr) {
+    for (vma_t* vma = proc->vmas; vma != 0; vma = vma->next) {
+        if (addr < vma->start) {
+            break;
+        }
+        if (addr < vma->end) {
+            return vma;
+        }
+    }
+    return 0;
+}
+
+/* Give dst a copy of src's regions */
+int vma_copy(process_t* dst, process_t* src) {
+    vma_t** tail = &dst->vmas;
+
+    for (vma_t* vma = src->vmas; vma != 0; vma = vma->next) {
+        vma_t* copy = (vma_t*)kmem_cache_alloc(vma_cache);
+        if (copy == 0) {
+            vma_free_all(dst);
+            return -1;
+        }
+
+        *copy = *vma;
+        copy->next = 0;
+        if (copy->image != 0) {
+            image_get(copy->image);
+        }
+        *tail = copy;
+        tail = &copy->next;
+    }
+
+    return 0;
+}
+
+/* Drop all regions of a process */
+void vma_free_all(process_t* proc) {
+    vma_t* vma = proc->vmas;
+    while (vma != 0) {
+        vma_t* next = vma->next;
+        image_put(vma->image);
+        kmem_cache_free(vma_cache, vma);
+        vma = next;
+    }
+    proc->vmas = 0;
+}
+
+/* Unlink and free one region */
+static void vma_remove(process_t* proc, vma_t* target) {
+    vma_t** link = &proc->vmas;
+    while (*link != 0) {
+        if (*link == target) {
+            *link = target->next;
+            image_put(target->image);
+            kmem_cache_free(vma_cache, target);
+            return;
+        }
+        link = &(*link)->next;
+    }
+}
+
+/* Move the program break */
+int vma_brk(process_t* proc, uint32_t new_brk) {
+    if ((proc->heap_start == 0) || (new_brk < proc->heap_start)) {
+        return -1;
+    }
+
+    uint32_t old_top = page_up(proc->heap_end);
+    uint32_t new_top = page_up(new_brk);
+    vma_t* heap = (old_top > proc->heap_start) ?
+                  vma_find(proc, proc->heap_start) : 0;
+
+    if (new_top > old_top) {
+        if (vma_overlaps(proc, old_top, new_top) ||
+            (new_top > KERNEL_VIRT_START)) {
+            return -1;
+        }
+
+        if (heap != 0) {
+            heap->end = new_top;
+        } else if (vma_add(proc, proc->heap_start, new_top,
+                           VMA_READ | VMA_WRITE | VMA_HEAP) != 0) {
+            return -1;
+        }
+    } else if (new_top < old_top) {
+        /* Hand back whatever was touched above the new break */
+        vmm_unmap_range_in(proc->page_dir, new_top,
+                           (old_top - new_top) / PAGE_SIZE);
+
+        if (new_top == proc->heap_start) {
+            vma_remove(proc, heap);
+        } else {
+            heap->end = new_top;
+        }
+    }
+
+    proc->heap_end = new_brk;
+    return 0;
+}
+
+/* Frame holding the contents of one page of a region, and the flags to
+   map it with */
+static uint32_t vma_fill_page(vma_t* vma, uint32_t page, int write,
+                              uint32_t* flags) {
+    uint32_t copy_start = (page > vma->file_start) ? page : vma->file_start;
+    uint32_t copy_end = (page + PAGE_SIZE < vma->file_end) ?
+                        page + PAGE_SIZE : vma->file_end;
+
+    *flags = PAGE_PRESENT | PAGE_USER;
+    if (vma->flags & VMA_WRITE) {
+        *flags |= PAGE_WRITE;
+    }
+
+    /* Anonymous memory, or a page of pure BSS */
+    if ((vma->image == 0) || (copy_start >= copy_end)) {
+        return pmm_alloc_zeroed_frame();
+    }
+
+    uint32_t offset = vma->offset + (copy_start - vma->file_start);
+
+    /* A page that is all file data comes from the image's page cache,
+       shared with every other mapping of it: read-only pages as they
+       are, writable ones copy-on-write until the first write. A write
+       fault skips straight to a private copy. */
+    if ((copy_start == page) && (copy_end == page + PAGE_SIZE) &&
+        ((offset & 0xFFFU) == 0U) &&
+        (!(vma->flags & VMA_WRITE) || !write)) {
+        if (vma->flags & VMA_WRITE) {
+            *flags = (*flags & ~PAGE_WRITE) | PAGE_COW;
+        }
+        return image_page_frame(vma->image, offset);
+    }
+
+    /* Otherwise the process gets a private copy */
+    uint32_t phys = pmm_alloc_zeroed_frame();
+    if (phys == 0) {
+        return 0;
+    }
+
+    uint32_t dest = vmm_kmap_atomic(phys);
+    if (dest == 0) {
+        pmm_free_frame(phys);
+        return 0;
+    }
+    memcpy((uint8_t*)dest + (copy_start - page),
+           vma->image->data + offset, copy_end - copy_start);
+    vmm_kunmap_atomic(dest);
+
+    return phys;
+}
+
+/* Fill a not-present page of the current process on first touch */
+int vma_handle_fault(uint32_t fault_addr, uint32_t error_code) {
+    /* Only missing pages are filled; protection faults are not ours */
+    if (error_code & PF_PRESENT) {
+        return -1;
+    }
+
+    process_t* proc = process_get_current();
+    if ((proc == 0) || (proc->page_dir != vmm_get_current_directory())) {
+        return -1;
+    }
+
+    vma_t* vma = vma_find(proc, fault_addr);
+    if (vma == 0) {
+        return -1;
+    }
+
+    if ((error_code & PF_WRITE) && !(vma->flags & VMA_WRITE)) {
+        return -1;
+    }
+
+    /* The new entry goes into a page table of this process's own, not
+       one still shared with its parent or child after fork */
+    if (vmm_unshare_page_table(proc->page_dir, fault_addr >> 22) != 0) {
+        return -1;
+    }
+
+    uint32_t flags;
+    uint32_t phys = vma_fill_page(vma, page_down(fault_addr),
+                                  (error_code & PF_WRITE) != 0U, &flags);
+    if (phys == 0) {
+        vga_print("[-] vma: Out of memory filling a page\n");
+        return -1;
+    }
+
+    vmm_map_page(page_down(fault_addr), phys, flags);
+    return 0;
+}
@@ -4,6 +4,8 @@
 #include <kernel/vmm.h>
 #include <kernel/pmm.h>
 #include <kernel/vga.h>
+#include <kernel/uaccess.h>
+#include <kernel/vma.h>
 
 /* Kernel page directory */
 static page_directory_t* kernel_directory;
@@ -14,6 +16,29 @@ static page_directory_t* current_directory;
 /* Physical address of kernel page directory */
 static uint32_t kernel_pd_phys;
 
+/* Set once CR4.PSE is on, so PDEs may map 4MB pages */
+static int large_pages = 0;
+
+/* Set once paging is on and page tables can be reached through the
+   recursive slot instead of the phys + KERNEL_VIRT_START window */
+static int recursive_ready = 0;
+
+/* Directory reachable through the foreign slot, and the directory whose
+   foreign PDE points at it */
+static page_directory_t* foreign_dir = 0;
+static page_directory_t* foreign_host = 0;
+
+/* Foreign slot windows that may be cached in the TLB */
+static uint32_t foreign_touched[1024 / 32];
+
+/* Per-CPU kmap stack: slots in use, and the interrupt flag saved by each */
+typedef struct {
+    uint32_t depth;
+    uint32_t irq_flags[KMAP_SLOTS];
+} kmap_cpu_t;
+
+static kmap_cpu_t kmap_cpus[PMM_MAX_CPUS];
+
 /* Kernel virtual address space starts at 3GB */
 #ifndef KERNEL_VIRT_START
 #define KERNEL_VIRT_START 0xC0000000U
@@ -39,17 +64,74 @@ static inline uint32_t* get_pde(page_directory_t* pd, uint32_t virt_addr) {
     return &pd->entries[get_table_index(virt_addr)];
 }
 
+/* Page table behind a present PDE of the live directory */
+static inline page_table_t* live_table(uint32_t table_idx, uint32_t pde) {
+    if (recursive_ready) {
+        return (page_table_t*)(VMM_PAGE_TABLES + table_idx * PAGE_SIZE);
+    }
+    /* Before paging, convert the physical address to the kernel window */
+    return (page_table_t*)((pde & 0xFFFFF000) + KERNEL_VIRT_START);
+}
+
 /* Get page table entry */
 static inline uint32_t* get_pte(page_directory_t* pd, uint32_t virt_addr) {
     uint32_t* pde = get_pde(pd, virt_addr);
-    if (!(*pde & PAGE_PRESENT)) {
+    if (!(*pde & PAGE_PRESENT) || (*pde & PAGE_LARGE)) {
         return 0;
     }
-    /* Convert physical page table address to kernel virtual address before dereferencing */
-    page_table_t* pt = (page_table_t*)(((*pde) & 0xFFFFF000) + KERNEL_VIRT_START);
+
+    page_table_t* pt;
+    if (pd == current_directory) {
+        pt = live_table(get_table_index(virt_addr), *pde);
+    } else {
+        pt = (page_table_t*)(((*pde) & 0xFFFFF000) + KERNEL_VIRT_START);
+    }
     return &pt->entries[get_page_index(virt_addr)];
 }
 
+/* Get a page table entry of the live directory for writing, first giving
+   the directory its own copy of a table it shares after fork */
+static uint32_t* get_pte_private(uint32_t virt_addr) {
+    if (vmm_unshare_page_table(current_directory,
+                               get_table_index(virt_addr)) != 0) {
+        return 0;
+    }
+    return get_pte(current_directory, virt_addr);
+}
+
+/* Drop any TLB entries made through the foreign slot */
+static void foreign_flush(void) {
+    vmm_flush_tlb(VMM_FOREIGN_DIR);
+
+    for (uint32_t i = 0; i < 1024 / 32; i++) {
+        while (foreign_touched[i] != 0) {
+            uint32_t bit = (uint32_t)__builtin_ctz(foreign_touched[i]);
+            foreign_touched[i] &= foreign_touched[i] - 1U;
+            vmm_flush_tlb(VMM_FOREIGN_TABLES + (i * 32 + bit) * PAGE_SIZE);
+        }
+    }
+}
+
+/* Point the live directory's foreign slot at pd */
+static void foreign_attach(page_directory_t* pd) {
+    if ((foreign_dir == pd) && (foreign_host == current_directory)) {
+        return;
+    }
+
+    current_directory->entries[VMM_FOREIGN_SLOT] =
+        ((uint32_t)pd - KERNEL_VIRT_START) | PAGE_PRESENT | PAGE_WRITE;
+    foreign_flush();
+
+    foreign_dir = pd;
+    foreign_host = current_directory;
+}
+
+/* Window onto page table `index` of the attached foreign directory */
+static inline page_table_t* foreign_table(uint32_t index) {
+    foreign_touched[index / 32] |= 1U << (index % 32);
+    return (page_table_t*)(VMM_FOREIGN_TABLES + index * PAGE_SIZE);
+}
+
 /* Initialize virtual memory manager */
 void vmm_init(void) {
     vga_print("[+] Initializing Virtual Memory Manager...\n");
@@ -68,21 +150,88 @@ void vmm_init(void) {
         kernel_directory->entries[i] = 0;
     }
 
-    /* Map kernel space (identity mapping for first 4MB) */
-    for (uint32_t i = 0; i < 0x400000; i += PAGE_SIZE) {
-        vmm_map_page(i, i, PAGE_PRESENT | PAGE_WRITE);
-    }
+    /* Recursive slot: the directory doubles as its own last page table */
+    kernel_directory->entries[VMM_RECURSIVE_SLOT] =
+        kernel_pd_phys | PAGE_PRESENT | PAGE_WRITE;
 
-    /* Map kernel to higher half (3GB+) */
-    for (uint32_t i = 0x100000; i < 0x200000; i += PAGE_SIZE) {
-        vmm_map_page(i + KERNEL_VIRT_START - KERNEL_PHYS_BASE, i,
-                     PAGE_PRESENT | PAGE_WRITE);
+    /* The page table behind the temporary mappings and kmap slots is made
+       before any process directory copies the kernel half, so it is
+       shared and kmap can write its PTEs at a fixed address */
+    uint32_t temp_pt_phys = pmm_alloc_frame();
+    if (temp_pt_phys == 0) {
+        vga_print("[-] Failed to allocate temporary mapping table!\n");
+        return;
+    }
+    page_table_t* temp_pt = (page_table_t*)(temp_pt_phys + KERNEL_VIRT_START);
+    for (uint32_t i = 0; i < 1024; i++) {
+        temp_pt->entries[i] = 0;
+    }
+    kernel_directory->entries[get_table_index(TEMP_MAPPING_BASE)] =
+        temp_pt_phys | PAGE_PRESENT | PAGE_WRITE;
+
+    /* Likewise for the slab region, so slabs mapped later are visible in
+       every address space */
+    uint32_t slab_pt_phys = pmm_alloc_frame();
+    if (slab_pt_phys == 0) {
+        vga_print("[-] Failed to allocate slab page table!\n");
+        return;
+    }
+    page_table_t* slab_pt = (page_table_t*)(slab_pt_phys + KERNEL_VIRT_START);
+    for (uint32_t i = 0; i < 1024; i++) {
+        slab_pt->entries[i] = 0;
+    }
+    kernel_directory->entries[get_table_index(SLAB_VIRT_BASE)] =
+        slab_pt_phys | PAGE_PRESENT | PAGE_WRITE;
+
+    /* Use 4MB pages when the CPU supports them (cpu_enable_features has
+       set CR4.PSE) */
+    uint32_t cr4;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    large_pages = (cr4 & (1U << 4)) != 0U;
+
+    /* Map kernel space: identity mapping for the first 4MB, and the same
+       memory in the higher half at phys + KERNEL_VIRT_START (kernel image,
+       initial heap). The higher half is shared by every address space, so
+       it is global and survives CR3 reloads; the identity mapping is not,
+       since the same addresses are user space in processes. */
+    if (large_pages) {
+        vmm_map_large_page(0, 0, PAGE_PRESENT | PAGE_WRITE);
+        vmm_map_large_page(KERNEL_VIRT_START, 0,
+                           PAGE_PRESENT | PAGE_WRITE | PAGE_GLOBAL);
+    } else {
+        for (uint32_t i = 0; i < LARGE_PAGE_SIZE; i += PAGE_SIZE) {
+            vmm_map_page(i, i, PAGE_PRESENT | PAGE_WRITE);
+            vmm_map_page(i + KERNEL_VIRT_START, i,
+                         PAGE_PRESENT | PAGE_WRITE | PAGE_GLOBAL);
+        }
     }
 
-    /* Map frames bitmap */
-    for (uint32_t i = 0x200000; i < 0x300000; i += PAGE_SIZE) {
-        vmm_map_page(i + KERNEL_VIRT_START - KERNEL_PHYS_BASE, i,
-                     PAGE_PRESENT | PAGE_WRITE);
+    /* Map PMM metadata (bitmap, refcounts, buddy arrays) in its kernel
+       region, shared by every address space. With large pages the
+       region starts at the 4MB boundary below the metadata. */
+    uint32_t meta_start;
+    uint32_t meta_end;
+    pmm_get_metadata_region(&meta_start, &meta_end);
+    uint32_t meta_base = meta_start;
+    if (large_pages) {
+        meta_base &= ~(LARGE_PAGE_SIZE - 1U);
+    }
+    if (meta_end - meta_base > PMM_META_VIRT_SIZE) {
+        vga_print("[-] PMM metadata does not fit its region!\n");
+        __asm__ volatile("cli; hlt");
+    }
+    if (meta_start == 0U) {
+        meta_end = 0;
+    }
+    for (uint32_t i = meta_base; i < meta_end;
+         i += large_pages ? LARGE_PAGE_SIZE : PAGE_SIZE) {
+        uint32_t virt = PMM_META_VIRT_BASE + (i - meta_base);
+        if (large_pages) {
+            vmm_map_large_page(virt, i,
+                               PAGE_PRESENT | PAGE_WRITE | PAGE_GLOBAL);
+        } else {
+            vmm_map_page(virt, i, PAGE_PRESENT | PAGE_WRITE | PAGE_GLOBAL);
+        }
     }
 
     /* Enable paging - use the saved physical address directly */
@@ -96,11 +245,16 @@ void vmm_init(void) {
         : "%eax"
     );
 
+    /* Physical pointers into the metadata stop working here */
+    pmm_relocate_metadata(PMM_META_VIRT_BASE + (meta_start - meta_base));
+
+    recursive_ready = 1;
+
     vga_print("    Paging enabled\n");
 }
 
-/* Map a virtual page to a physical page */
-void vmm_map_page(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags) {
+/* Set a PTE without flushing the TLB, returns the previous entry */
+static uint32_t set_page(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags) {
     uint32_t table_idx = get_table_index(virt_addr);
     uint32_t page_idx = get_page_index(virt_addr);
 
@@ -108,38 +262,67 @@ void vmm_map_page(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags) {
     uint32_t* pde = &current_directory->entries[table_idx];
     page_table_t* pt;
 
+    if (*pde & PAGE_LARGE) {
+        vga_print("[-] vmm: Page lies inside a large page\n");
+        return 0;
+    }
+
+    if ((*pde & PAGE_SHARED_TABLE) &&
+        (vmm_unshare_page_table(current_directory, table_idx) != 0)) {
+        return 0;
+    }
+
     if (!(*pde & PAGE_PRESENT)) {
-        /* Allocate new page table */
-        uint32_t pt_phys = pmm_alloc_frame();
+        /* Allocate new page table, preferring a pre-zeroed frame.
+           pmm_alloc_zeroed_frame() cannot be used here: zeroing inline
+           maps a temp page, which may itself need a page table. */
+        uint32_t pt_phys = pmm_zero_pool_take();
+        int pt_zeroed = (pt_phys != 0U);
+        if (pt_zeroed == 0) {
+            pt_phys = pmm_alloc_frame();
+        }
         if (pt_phys == 0) {
             vga_print("[-] Failed to allocate page table!\n");
             /* Allocation failure during page table creation is fatal during boot: halt to avoid enabling paging with incomplete mappings. */
             __asm__ volatile("cli; hlt");
         }
-        pt = (page_table_t*)(pt_phys + KERNEL_VIRT_START);
+        /* Set page directory entry. Access is decided by the PTEs, so
+           the PDE is always writable; through the recursive slot it is
+           also read as a PTE, so it must not carry the global bit. */
+        *pde = pt_phys | (flags & PAGE_USER) | PAGE_PRESENT | PAGE_WRITE;
+        pt = live_table(table_idx, *pde);
+        if (recursive_ready) {
+            vmm_flush_tlb((uint32_t)pt);
+        }
 
         /* Clear page table */
-        for (uint32_t i = 0; i < 1024; i++) {
-            pt->entries[i] = 0;
+        if (pt_zeroed == 0) {
+            for (uint32_t i = 0; i < 1024; i++) {
+                pt->entries[i] = 0;
+            }
         }
-
-        /* Set page directory entry */
-        *pde = pt_phys | flags | PAGE_PRESENT;
     } else {
-        /* Convert PDE physical address to kernel virtual address */
-        pt = (page_table_t*)(((*pde) & 0xFFFFF000) + KERNEL_VIRT_START);
+        pt = live_table(table_idx, *pde);
     }
 
     /* Map the page */
+    uint32_t old = pt->entries[page_idx];
     pt->entries[page_idx] = phys_addr | flags | PAGE_PRESENT;
+    return old;
+}
 
-    /* Flush TLB */
-    vmm_flush_tlb(virt_addr);
+/* Map a virtual page to a physical page */
+void vmm_map_page(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags) {
+    /* Not-present entries are never cached, so only a replaced mapping
+       needs flushing */
+    if (set_page(virt_addr, phys_addr, flags) & PAGE_PRESENT) {
+        vmm_flush_tlb(virt_addr);
+    }
 }
 
 /* Unmap a virtual page */
 void vmm_unmap_page(uint32_t virt_addr) {
-    uint32_t* pte = get_pte(current_directory, virt_addr);
+    uint32_t* pte = get_pte_private(virt_addr);
 
     if (pte && (*pte & PAGE_PRESENT)) {
         /* Free the frame */
@@ -153,9 +336,91 @@ void vmm_unmap_page(uint32_t virt_addr) {
     }
 }
 
+/* Start an empty batch */
+void vmm_flush_batch_init(vmm_flush_batch_t* batch) {
+    batch->count = 0;
+    batch->global = 0;
+}
+
+/* Queue a page whose mapping changed */
+void vmm_flush_batch_add(vmm_flush_batch_t* batch, uint32_t virt_addr) {
+    if (batch->count < VMM_FLUSH_MAX) {
+        batch->addrs[batch->count] = virt_addr;
+    }
+    batch->count++;
+
+    if (virt_addr >= KERNEL_VIRT_START) {
+        batch->global = 1;
+    }
+}
+
+/* Flush everything queued and empty the batch */
+void vmm_flush_batch_finish(vmm_flush_batch_t* batch) {
+    if (batch->count <= VMM_FLUSH_MAX) {
+        for (uint32_t i = 0; i < batch->count; i++) {
+            vmm_flush_tlb(batch->addrs[i]);
+        }
+    } else if (batch->global) {
+        /* Kernel entries may be global and survive a CR3 reload */
+        vmm_flush_tlb_all();
+    } else {
+        vmm_flush_tlb_user();
+    }
+
+    vmm_flush_batch_init(batch);
+}
+
+/* Map a range of pages with one batched flush */
+void vmm_map_range(uint32_t virt_addr, const uint32_t* frames, uint32_t count,
+                   uint32_t flags) {
+    vmm_flush_batch_t batch;
+    vmm_flush_batch_init(&batch);
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t addr = virt_addr + i * PAGE_SIZE;
+        if (set_page(addr, frames[i], flags) & PAGE_PRESENT) {
+            vmm_flush_batch_add(&batch, addr);
+        }
+    }
+
+    vmm_flush_batch_finish(&batch);
+}
+
+/* Unmap a range of pages with one batched flush */
+void vmm_unmap_range(uint32_t virt_addr, uint32_t count) {
+    vmm_flush_batch_t batch;
+    vmm_flush_batch_init(&batch);
+
+    /* Frames are released in bulk before the final flush. With a single
+       CPU nothing touches the range in between, so the stale entries are
+       never used. */
+    uint32_t frames[PMM_BULK_BATCH];
+    uint32_t pending = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t addr = virt_addr + i * PAGE_SIZE;
+        uint32_t* pte = get_pte_private(addr);
+        if (!pte || !(*pte & PAGE_PRESENT)) {
+            continue;
+        }
+
+        frames[pending++] = *pte & 0xFFFFF000;
+        *pte = 0;
+        vmm_flush_batch_add(&batch, addr);
+
+        if (pending == PMM_BULK_BATCH) {
+            pmm_free_frames_bulk(frames, pending);
+            pending = 0;
+        }
+    }
+
+    pmm_free_frames_bulk(frames, pending);
+    vmm_flush_batch_finish(&batch);
+}
+
 /* Unmap a virtual page without freeing the physical frame */
 void vmm_unmap_page_no_free(uint32_t virt_addr) {
-    uint32_t* pte = get_pte(current_directory, virt_addr);
+    uint32_t* pte = get_pte_private(virt_addr);
 
     if (pte && (*pte & PAGE_PRESENT)) {
         /* Clear the entry but DON'T free the frame */
@@ -166,8 +431,104 @@ void vmm_unmap_page_no_free(uint32_t virt_addr) {
     }
 }
 
+/* Turn global pages on or off */
+int vmm_set_global_pages(int enable) {
+    uint32_t cr4;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+
+    uint32_t new_cr4 = enable ? (cr4 | CR4_PGE) : (cr4 & ~CR4_PGE);
+    if (new_cr4 != cr4) {
+        __asm__ volatile("mov %0, %%cr4" : : "r"(new_cr4) : "memory");
+    }
+
+    return (cr4 & CR4_PGE) != 0U;
+}
+
+/* Flush the whole TLB, including global entries */
+void vmm_flush_tlb_all(void) {
+    if (vmm_set_global_pages(0)) {
+        /* Toggling CR4.PGE drops every entry, global ones included */
+        vmm_set_global_pages(1);
+    } else {
+        uint32_t cr3;
+        __asm__ volatile("mov %%cr3, %0" : "=r"(cr3));
+        __asm__ volatile("mov %0, %%cr3" : : "r"(cr3) : "memory");
+    }
+}
+
+/* Flush every non-global TLB entry */
+void vmm_flush_tlb_user(void) {
+    uint32_t cr3 = vmm_get_cr3();
+    __asm__ volatile("mov %0, %%cr3" : : "r"(cr3) : "memory");
+}
+
+/* Check whether large pages can be used */
+int vmm_large_pages_enabled(void) {
+    return large_pages;
+}
+
+/* Map a 4MB page */
+int vmm_map_large_page(uint32_t virt_addr, uint32_t phys_addr, uint32_t flags) {
+    if (!large_pages) {
+        return -1;
+    }
+
+    if (((virt_addr | phys_addr) & (LARGE_PAGE_SIZE - 1U)) != 0U) {
+        vga_print("[-] vmm: Large page is not 4MB aligned\n");
+        return -1;
+    }
+
+    uint32_t* pde = get_pde(current_directory, virt_addr);
+    if ((*pde & PAGE_PRESENT) && !(*pde & PAGE_LARGE)) {
+        vga_print("[-] vmm: Large page overlaps a page table\n");
+        return -1;
+    }
+
+    *pde = phys_addr | flags | PAGE_PRESENT | PAGE_LARGE;
+
+    /* One invlpg drops the whole 4MB translation */
+    vmm_flush_tlb(virt_addr);
+    return 0;
+}
+
+/* Allocate a 4MB frame block and map it as a large page */
+int vmm_alloc_large_page(uint32_t virt_addr, uint32_t flags) {
+    if (!large_pages) {
+        return -1;
+    }
+
+    uint32_t phys = pmm_alloc_frames(LARGE_PAGE_ORDER);
+    if (phys == 0) {
+        return -1;
+    }
+
+    if (vmm_map_large_page(virt_addr, phys, flags) != 0) {
+        pmm_free_frames(phys, LARGE_PAGE_ORDER);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Unmap a large page and free its frames */
+void vmm_unmap_large_page(uint32_t virt_addr) {
+    uint32_t* pde = get_pde(current_directory, virt_addr);
+
+    if ((*pde & PAGE_PRESENT) && (*pde & PAGE_LARGE)) {
+        pmm_free_frames(*pde & ~(LARGE_PAGE_SIZE - 1U), LARGE_PAGE_ORDER);
+        *pde = 0;
+        vmm_flush_tlb(virt_addr);
+    }
+}
+
 /* Get physical address of a virtual page */
 uint32_t vmm_get_phys_addr(uint32_t virt_addr) {
+    uint32_t pde = *get_pde(current_directory, virt_addr);
+    if ((pde & PAGE_PRESENT) && (pde & PAGE_LARGE)) {
+        return (pde & ~(LARGE_PAGE_SIZE - 1U)) +
+               (virt_addr & (LARGE_PAGE_SIZE - 1U));
+    }
+
     uint32_t* pte = get_pte(current_directory, virt_addr);
 
     if (!pte || !(*pte & PAGE_PRESENT)) {
@@ -177,25 +538,258 @@ uint32_t vmm_get_phys_addr(uint32_t virt_addr) {
     return (*pte & 0xFFFFF000) + (virt_addr & 0xFFF);
 }
 
+/* Page table of any directory through the recursive slots */
+page_table_t* vmm_get_page_table(page_directory_t* pd, uint32_t index) {
+    uint32_t pde = pd->entries[index];
+    if (!(pde & PAGE_PRESENT) || (pde & PAGE_LARGE)) {
+        return 0;
+    }
+
+    if (!recursive_ready) {
+        return (page_table_t*)((pde & 0xFFFFF000) + KERNEL_VIRT_START);
+    }
+
+    if (pd == current_directory) {
+        return live_table(index, pde);
+    }
+
+    foreign_attach(pd);
+    return foreign_table(index);
+}
+
+/* Give a directory its own copy of a page table shared after fork */
+int vmm_unshare_page_table(page_directory_t* pd, uint32_t index) {
+    uint32_t pde = pd->entries[index];
+    if (!(pde & PAGE_PRESENT) || (pde & PAGE_LARGE) ||
+        !(pde & PAGE_SHARED_TABLE)) {
+        return 0;
+    }
+
+    uint32_t irq = pmm_irq_save();
+    uint32_t table = pde & 0xFFFFF000;
+
+    if (pmm_get_ref_count(table) > 1U) {
+        /* Both copies of the table now map every page, so each frame
+           gains a reference and writable pages turn COW in both. The
+           shared table is only reachable here through a kmap: its PDEs
+           are read-only, which also covers the recursive window. */
+        uint32_t copy = pmm_alloc_frame();
+        uint32_t src = (copy != 0U) ? vmm_kmap_atomic(table) : 0U;
+        uint32_t dest = (src != 0U) ? vmm_kmap_atomic(copy) : 0U;
+        if (dest == 0U) {
+            if (src != 0U) {
+                vmm_kunmap_atomic(src);
+            }
+            if (copy != 0U) {
+                pmm_free_frame(copy);
+            }
+            pmm_irq_restore(irq);
+            vga_print("[-] vmm: Failed to copy shared page table\n");
+            return -1;
+        }
+
+        page_table_t* src_pt = (page_table_t*)src;
+        page_table_t* dest_pt = (page_table_t*)dest;
+        for (uint32_t j = 0; j < 1024U; j++) {
+            uint32_t pte = src_pt->entries[j];
+            if (pte & PAGE_PRESENT) {
+                if (pte & (PAGE_WRITE | PAGE_COW)) {
+                    pte = (pte & ~PAGE_WRITE) | PAGE_COW;
+                    src_pt->entries[j] = pte;
+                }
+                pmm_ref_frame(pte & 0xFFFFF000);
+            }
+            dest_pt->entries[j] = pte;
+        }
+
+        vmm_kunmap_atomic(dest);
+        vmm_kunmap_atomic(src);
+
+        /* Drop this directory's reference to the shared table */
+        pmm_free_frame(table);
+        table = copy;
+    }
+
+    pd->entries[index] = table | (pde & 0xFFF & ~PAGE_SHARED_TABLE) |
+                         PAGE_WRITE;
+
+    /* Read-only translations of the region and of the table's window may
+       be cached */
+    if (pd == current_directory) {
+        vmm_flush_tlb_user();
+    } else if ((pd == foreign_dir) && (foreign_host == current_directory)) {
+        vmm_flush_tlb(VMM_FOREIGN_TABLES + index * PAGE_SIZE);
+    }
+
+    pmm_irq_restore(irq);
+    return 0;
+}
+
+/* Map a page in any address space */
+int vmm_map_page_in(page_directory_t* pd, uint32_t virt_addr,
+                    uint32_t phys_addr, uint32_t flags) {
+    return vmm_map_range_in(pd, virt_addr, &phys_addr, 1, flags);
+}
+
+/* Map a range of pages in any address space */
+int vmm_map_range_in(page_directory_t* pd, uint32_t virt_addr,
+                     const uint32_t* frames, uint32_t count, uint32_t flags) {
+    if (pd == current_directory) {
+        vmm_map_range(virt_addr, frames, count, flags);
+        return 0;
+    }
+
+    if (!recursive_ready) {
+        vga_print("[-] vmm: Foreign mapping before paging is enabled\n");
+        return -1;
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+
+    /* The directory is not live, so nothing needs flushing */
+    uint32_t irq = pmm_irq_save();
+
+    /* Create missing page tables first, so a failure maps nothing */
+    uint32_t last_idx = get_table_index(virt_addr + (count - 1U) * PAGE_SIZE);
+    for (uint32_t idx = get_table_index(virt_addr); idx <= last_idx; idx++) {
+        uint32_t* pde = &pd->entries[idx];
+
+        if (*pde & PAGE_LARGE) {
+            pmm_irq_restore(irq);
+            vga_print("[-] vmm: Page lies inside a large page\n");
+            return -1;
+        }
+
+        if (vmm_unshare_page_table(pd, idx) != 0) {
+            pmm_irq_restore(irq);
+            return -1;
+        }
+
+        if (!(*pde & PAGE_PRESENT)) {
+            uint32_t pt_phys = pmm_alloc_zeroed_frame();
+            if (pt_phys == 0) {
+                pmm_irq_restore(irq);
+                vga_print("[-] Failed to allocate page table!\n");
+                return -1;
+            }
+            *pde = pt_phys | (flags & PAGE_USER) | PAGE_PRESENT | PAGE_WRITE;
+        }
+    }
+
+    foreign_attach(pd);
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t addr = virt_addr + i * PAGE_SIZE;
+        page_table_t* pt = foreign_table(get_table_index(addr));
+        pt->entries[get_page_index(addr)] = frames[i] | flags | PAGE_PRESENT;
+    }
+
+    pmm_irq_restore(irq);
+    return 0;
+}
+
+/* Unmap a range of pages in any address space */
+void vmm_unmap_range_in(page_directory_t* pd, uint32_t virt_addr,
+                        uint32_t count) {
+    if (pd == current_directory) {
+        vmm_unmap_range(virt_addr, count);
+        return;
+    }
+
+    if (!recursive_ready) {
+        vga_print("[-] vmm: Foreign unmapping before paging is enabled\n");
+        return;
+    }
+
+    /* The directory is not live, so nothing needs flushing */
+    uint32_t irq = pmm_irq_save();
+    uint32_t frames[PMM_BULK_BATCH];
+    uint32_t pending = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t addr = virt_addr + i * PAGE_SIZE;
+        uint32_t index = get_table_index(addr);
+        uint32_t pde = pd->entries[index];
+        if (!(pde & PAGE_PRESENT) || (pde & PAGE_LARGE)) {
+            continue;
+        }
+
+        /* Tables still shared with a fork relative get a private copy */
+        if (vmm_unshare_page_table(pd, index) != 0) {
+            break;
+        }
+
+        foreign_attach(pd);
+        uint32_t* pte = &foreign_table(index)->entries[get_page_index(addr)];
+        if (!(*pte & PAGE_PRESENT)) {
+            continue;
+        }
+
+        frames[pending++] = *pte & 0xFFFFF000;
+        *pte = 0;
+
+        if (pending == PMM_BULK_BATCH) {
+            pmm_free_frames_bulk(frames, pending);
+            pending = 0;
+        }
+    }
+
+    pmm_free_frames_bulk(frames, pending);
+    pmm_irq_restore(irq);
+}
+
+/* Get the physical address of a virtual page in any address space */
+uint32_t vmm_get_phys_addr_in(page_directory_t* pd, uint32_t virt_addr) {
+    if (pd == current_directory) {
+        return vmm_get_phys_addr(virt_addr);
+    }
+
+    uint32_t pde = *get_pde(pd, virt_addr);
+    if ((pde & PAGE_PRESENT) && (pde & PAGE_LARGE)) {
+        return (pde & ~(LARGE_PAGE_SIZE - 1U)) +
+               (virt_addr & (LARGE_PAGE_SIZE - 1U));
+    }
+
+    uint32_t irq = pmm_irq_save();
+    page_table_t* pt = vmm_get_page_table(pd, get_table_index(virt_addr));
+    uint32_t pte = pt ? pt->entries[get_page_index(virt_addr)] : 0;
+    pmm_irq_restore(irq);
+
+    if (!(pte & PAGE_PRESENT)) {
+        return 0;
+    }
+
+    return (pte & 0xFFFFF000) + (virt_addr & 0xFFF);
+}
+
 /* Allocate a new page directory for a process */
 page_directory_t* vmm_create_page_directory(void) {
-    /* Allocate page directory */
-    uint32_t pd_phys = pmm_alloc_frame();
+    /* Allocate page directory (user half starts out empty) */
+    uint32_t pd_phys = pmm_alloc_zeroed_frame();
     if (pd_phys == 0) {
         vga_print("[-] Failed to allocate page directory!\n");
         return 0;
     }
     page_directory_t* pd = (page_directory_t*)(pd_phys + KERNEL_VIRT_START);
 
-    /* Clear page directory */
-    for (uint32_t i = 0; i < 1024; i++) {
-        pd->entries[i] = 0;
+    /* The kernel runs at its identity-mapped load address, so its
+       supervisor mappings below 3GB (the first 4MB) must be present in
+       every directory it may switch to; the rest of user space starts
+       out empty */
+    for (uint32_t i = 0; i < 768; i++) {
+        uint32_t pde = kernel_directory->entries[i];
+        if ((pde & PAGE_PRESENT) && !(pde & PAGE_USER)) {
+            pd->entries[i] = pde;
+        }
     }
 
-    /* Copy kernel mappings (last 256 entries, starting at 768) */
-    for (uint32_t i = 768; i < 1024; i++) {
+    /* Copy kernel mappings (entries 768 up to the foreign slot, which
+       starts out empty) */
+    for (uint32_t i = 768; i < VMM_FOREIGN_SLOT; i++) {
         pd->entries[i] = kernel_directory->entries[i];
     }
+    pd->entries[VMM_RECURSIVE_SLOT] = pd_phys | PAGE_PRESENT | PAGE_WRITE;
 
     return pd;
 }
@@ -209,6 +803,13 @@ void vmm_destroy_page_directory(page_directory_t* pd) {
         return;
     }
 
+    /* Frames are released in batches through the bulk PMM API */
+    uint32_t frames[PMM_BULK_BATCH];
+    uint32_t pending = 0;
+
+    /* Page tables are walked through the foreign slot */
+    uint32_t irq = pmm_irq_save();
+
     /* Free user-space mappings (PDE 0-767). Kernel space is shared. */
     for (uint32_t i = 0; i < 768U; i++) {
         uint32_t pde = pd->entries[i];
@@ -216,8 +817,37 @@ void vmm_destroy_page_directory(page_directory_t* pd) {
             continue;
         }
 
-        page_table_t* pt =
-            (page_table_t*)((pde & 0xFFFFF000U) + KERNEL_VIRT_START);
+        /* Kernel mappings cloned from a kernel thread's directory are
+           not this directory's to free */
+        if ((pde & PAGE_USER) == 0U) {
+            pd->entries[i] = 0;
+            continue;
+        }
+
+        if ((pde & PAGE_LARGE) != 0U) {
+            pmm_free_frames(pde & ~(LARGE_PAGE_SIZE - 1U), LARGE_PAGE_ORDER);
+            pd->entries[i] = 0;
+            continue;
+        }
+
+        /* A table still shared after fork keeps its pages for the other
+           directories: only this directory's reference to the table is
+           dropped. The last sharer owns the table and its pages. */
+        if ((pde & PAGE_SHARED_TABLE) != 0U) {
+            if (pmm_get_ref_count(pde & 0xFFFFF000U) > 1U) {
+                frames[pending++] = pde & 0xFFFFF000U;
+                pd->entries[i] = 0;
+                if (pending == PMM_BULK_BATCH) {
+                    pmm_free_frames_bulk(frames, pending);
+                    pending = 0;
+                }
+                continue;
+            }
+            vmm_unshare_page_table(pd, i);
+            pde = pd->entries[i];
+        }
+
+        page_table_t* pt = vmm_get_page_table(pd, i);
 
         for (uint32_t j = 0; j < 1024U; j++) {
             uint32_t pte = pt->entries[j];
@@ -225,14 +855,39 @@ void vmm_destroy_page_directory(page_directory_t* pd) {
                 continue;
             }
 
-            pmm_free_frame(pte & 0xFFFFF000U);
+            frames[pending++] = pte & 0xFFFFF000U;
             pt->entries[j] = 0;
+            if (pending == PMM_BULK_BATCH) {
+                pmm_free_frames_bulk(frames, pending);
+                pending = 0;
+            }
         }
 
-        pmm_free_frame(pde & 0xFFFFF000U);
+        /* The table itself is no longer referenced once its entries are
+           queued, so it can go in the same batch */
+        frames[pending++] = pde & 0xFFFFF000U;
         pd->entries[i] = 0;
+        if (pending == PMM_BULK_BATCH) {
+            pmm_free_frames_bulk(frames, pending);
+            pending = 0;
+        }
     }
 
+    /* Forget the foreign slot if it refers to this directory */
+    if ((pd == foreign_dir) || (pd == foreign_host)) {
+        if (foreign_host != pd) {
+            foreign_host->entries[VMM_FOREIGN_SLOT] = 0;
+        }
+        if (foreign_host == current_directory) {
+            foreign_flush();
+        }
+        foreign_dir = 0;
+        foreign_host = 0;
+    }
+
+    pmm_irq_restore(irq);
+
+    pmm_free_frames_bulk(frames, pending);
     pmm_free_frame((uint32_t)pd - KERNEL_VIRT_START);
 }
 
@@ -253,10 +908,31 @@ void vmm_switch_page_directory(page_directory_t* pd) {
 }
 
 /* Page fault handler */
-void vmm_page_fault_handler(uint32_t error_code) {
+void vmm_page_fault_handler(registers_t* regs) {
+    uint32_t error_code = regs->err_code;
     uint32_t fault_addr;
     __asm__ volatile("mov %%cr2, %0" : "=r"(fault_addr));
 
+    /* A missing page inside one of the process's regions is filled in
+       on first touch, whether the access came from user mode or from a
+       user copy routine */
+    if (vma_handle_fault(fault_addr, error_code) == 0) {
+        return;
+    }
+
+    /* Writes to copy-on-write pages, from user mode or from a user copy
+       routine, are resolved silently */
+    if ((error_code & PF_PRESENT) && (error_code & PF_WRITE) &&
+        (vmm_handle_cow_fault(fault_addr) == 0)) {
+        return;
+    }
+
+    /* Any other kernel fault inside a user copy routine fails the copy
+       with -EFAULT instead of halting */
+    if (!(error_code & PF_USER) && uaccess_fixup(regs)) {
+        return;
+    }
+
     vga_print("\n[-] PAGE FAULT!\n");
     vga_print("    Fault address: 0x");
     vga_print_hex(fault_addr);
@@ -267,19 +943,6 @@ void vmm_page_fault_handler(uint32_t error_code) {
 
     if (error_code & PF_PRESENT) {
         vga_print("    Page was present\n");
-        
-        /* Check if this is a COW page fault */
-        if (error_code & PF_WRITE && vmm_is_page_cow(fault_addr)) {
-            vga_print("    COW page fault detected\n");
-            
-            /* Handle COW page fault */
-            if (vmm_handle_cow_fault(fault_addr) == 0) {
-                vga_print("    COW page fault handled successfully\n");
-                return;  /* Fault handled, continue execution */
-            } else {
-                vga_print("    Failed to handle COW page fault\n");
-            }
-        }
     } else {
         vga_print("    Page not present\n");
     }
@@ -320,23 +983,75 @@ uint32_t vmm_get_cr3(void) {
     return cr3;
 }
 
+/* kmap state of the running CPU (uniprocessor for now) */
+static inline kmap_cpu_t* kmap_this_cpu(void) {
+    return &kmap_cpus[0];
+}
+
+/* Address of a CPU's kmap slot */
+static inline uint32_t kmap_slot_addr(kmap_cpu_t* cpu, uint32_t slot) {
+    uint32_t index = (uint32_t)(cpu - kmap_cpus) * KMAP_SLOTS + slot;
+    return KMAP_BASE + index * PAGE_SIZE;
+}
+
+/* Map a frame into the next free kmap slot */
+uint32_t vmm_kmap_atomic(uint32_t phys_addr) {
+    uint32_t irq = pmm_irq_save();
+    kmap_cpu_t* cpu = kmap_this_cpu();
+
+    if (!recursive_ready || (cpu->depth == KMAP_SLOTS)) {
+        pmm_irq_restore(irq);
+        vga_print("[-] vmm: No kmap slot available\n");
+        return 0;
+    }
+
+    uint32_t slot = cpu->depth++;
+    cpu->irq_flags[slot] = irq;
+
+    /* The shared table's PTEs sit at a fixed spot in the recursive window.
+       The slot's previous mapping may still be cached, so flush it. The
+       table is the same in every address space, so the entry can be
+       global. */
+    uint32_t virt_addr = kmap_slot_addr(cpu, slot);
+    uint32_t* pte = (uint32_t*)(VMM_PAGE_TABLES +
+                                (virt_addr >> 12) * sizeof(uint32_t));
+    *pte = (phys_addr & 0xFFFFF000) | PAGE_PRESENT | PAGE_WRITE | PAGE_GLOBAL;
+    vmm_flush_tlb(virt_addr);
+
+    return virt_addr;
+}
+
+/* Release the most recent kmap */
+void vmm_kunmap_atomic(uint32_t virt_addr) {
+    kmap_cpu_t* cpu = kmap_this_cpu();
+
+    if ((cpu->depth == 0) ||
+        (virt_addr != kmap_slot_addr(cpu, cpu->depth - 1U))) {
+        vga_print("[-] vmm: kmap released out of order\n");
+        return;
+    }
+
+    /* The PTE is left in place; the next kmap of the slot replaces and
+       flushes it */
+    cpu->depth--;
+    pmm_irq_restore(cpu->irq_flags[cpu->depth]);
+}
+
 /* Temporary mapping slot bitmap */
 static uint32_t temp_slots_bitmap[(TEMP_MAPPING_PAGES + 31) / 32];
 
 /* Allocate a temporary mapping slot */
 int vmm_alloc_temp_slot(void) {
-    /* Find a free slot */
-    for (uint32_t i = 0; i < TEMP_MAPPING_PAGES; i++) {
-        uint32_t bitmap_idx = i / 32;
-        uint32_t bit_idx = i % 32;
-        
-        if (!(temp_slots_bitmap[bitmap_idx] & (1 << bit_idx))) {
-            /* Mark slot as used */
-            temp_slots_bitmap[bitmap_idx] |= (1 << bit_idx);
-            return (int)i;
+    /* Find a word with a free slot, then the slot within it */
+    for (uint32_t i = 0; i < (TEMP_MAPPING_PAGES + 31) / 32; i++) {
+        uint32_t free_bits = ~temp_slots_bitmap[i];
+        if (free_bits != 0) {
+            uint32_t bit_idx = (uint32_t)__builtin_ctz(free_bits);
+            temp_slots_bitmap[i] |= 1U << bit_idx;
+            return (int)(i * 32 + bit_idx);
         }
     }
-    
+
     /* No free slots */
     return -1;
 }
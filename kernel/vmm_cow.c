@@ -20,15 +20,49 @@ static inline uint32_t* vmm_cow_get_pte(page_directory_t* pd,
         return 0;
     }
 
-    uint32_t pde = pd->entries[vmm_cow_get_table_index(virt_addr)];
-    if ((pde & PAGE_PRESENT) == 0U) {
+    page_table_t* pt =
+        vmm_get_page_table(pd, vmm_cow_get_table_index(virt_addr));
+    if (pt == 0) {
         return 0;
     }
 
-    page_table_t* pt = (page_table_t*)((pde & 0xFFFFF000U) + KERNEL_VIRT_START);
     return &pt->entries[vmm_cow_get_page_index(virt_addr)];
 }
 
+/* Give the child its own copy of a user 4MB page. Large pages are copied
+   at fork time rather than shared copy-on-write. */
+static int vmm_cow_copy_large_page(page_directory_t* new_dir, uint32_t index,
+                                   uint32_t src_pde) {
+    uint32_t src_phys = src_pde & ~(LARGE_PAGE_SIZE - 1U);
+    uint32_t new_phys = pmm_alloc_frames(LARGE_PAGE_ORDER);
+    if (new_phys == 0U) {
+        vga_print("[-] Failed to allocate large page for clone\n");
+        return -1;
+    }
+
+    /* One page at a time, so interrupts are only held off briefly */
+    for (uint32_t offset = 0; offset < LARGE_PAGE_SIZE; offset += PAGE_SIZE) {
+        uint32_t src = vmm_kmap_atomic(src_phys + offset);
+        uint32_t dest = (src != 0U) ? vmm_kmap_atomic(new_phys + offset) : 0U;
+        if (dest == 0U) {
+            if (src != 0U) {
+                vmm_kunmap_atomic(src);
+            }
+            vga_print("[-] Failed to map large page for clone\n");
+            pmm_free_frames(new_phys, LARGE_PAGE_ORDER);
+            return -1;
+        }
+
+        memcpy((void*)dest, (void*)src, PAGE_SIZE);
+
+        vmm_kunmap_atomic(dest);
+        vmm_kunmap_atomic(src);
+    }
+
+    new_dir->entries[index] = new_phys | (src_pde & (LARGE_PAGE_SIZE - 1U));
+    return 0;
+}
+
 /* Clone page directory for fork() */
 page_directory_t* vmm_clone_page_directory(page_directory_t* src) {
     if (src == 0) {
@@ -41,67 +75,68 @@ page_directory_t* vmm_clone_page_directory(page_directory_t* src) {
         vga_print("[-] Failed to create new page directory for clone\n");
         return 0;
     }
-    
-    /* Clone user space pages (first 768 entries = 3GB address space) */
-    for (uint32_t i = 0; i < 768U; i++) {
-        uint32_t src_pde = src->entries[i];
 
-        if ((src_pde & PAGE_PRESENT) != 0U) {
-            /* Get source page table */
-            page_table_t* src_pt =
-                (page_table_t*)((src_pde & 0xFFFFF000U) + KERNEL_VIRT_START);
+    /* Write-protecting the parent's PDEs only needs a TLB flush if its
+       directory is live */
+    int src_is_current = (src == vmm_get_current_directory());
+    int shared = 0;
 
-            /* Create new page table for this directory entry */
-            uint32_t new_pt_phys = pmm_alloc_frame();
-            if (new_pt_phys == 0U) {
-                vga_print("[-] Failed to allocate page table for clone\n");
-                return 0;
-            }
-
-            page_table_t* new_pt =
-                (page_table_t*)(new_pt_phys + KERNEL_VIRT_START);
-
-            /* Clear new page table */
-            memset(new_pt, 0, PAGE_SIZE);
-
-            /* Copy page table entries and mark as COW */
-            for (uint32_t j = 0; j < 1024U; j++) {
-                uint32_t src_pte = src_pt->entries[j];
-
-                if ((src_pte & PAGE_PRESENT) != 0U) {
-                    /* Mark source PTE as read-only and COW */
-                    src_pt->entries[j] = (src_pte & ~PAGE_WRITE) | PAGE_COW;
-
-                    /* Ensure the parent mapping is reloaded with the new flags. */
-                    uint32_t virt_addr = (i << 22) | (j << 12);
-                    vmm_flush_tlb(virt_addr);
+    /* Clone user space (first 768 entries = 3GB address space) */
+    for (uint32_t i = 0; i < 768U; i++) {
+        uint32_t src_pde = src->entries[i];
 
-                    /* Copy PTE but mark as read-only and COW */
-                    uint32_t new_pte =
-                        (src_pte & ~PAGE_WRITE) | PAGE_COW | PAGE_PRESENT;
-                    new_pt->entries[j] = new_pte;
+        if ((src_pde & PAGE_PRESENT) == 0U) {
+            continue;
+        }
 
-                    /* Increment reference count for the physical frame */
-                    uint32_t frame_addr = src_pte & 0xFFFFF000U;
-                    pmm_ref_frame(frame_addr);
+        if ((src_pde & PAGE_USER) == 0U) {
+            /* Kernel mappings below 3GB (the identity-mapped kernel image,
+               VGA memory, PMM metadata) are the same memory in every
+               address space. They are never copied or write-protected:
+               a kernel thread forking must not lose write access to its
+               own globals. */
+            new_dir->entries[i] = src_pde;
+        } else if ((src_pde & PAGE_LARGE) != 0U) {
+            if (vmm_cow_copy_large_page(new_dir, i, src_pde) != 0) {
+                vmm_destroy_page_directory(new_dir);
+                if (shared && src_is_current) {
+                    vmm_flush_tlb_user();
                 }
+                return 0;
             }
-
-            /* Set new page directory entry */
-            new_dir->entries[i] =
-                new_pt_phys | (src_pde & 0xFFFU) | PAGE_PRESENT | PAGE_USER;
+        } else {
+            /* Share the page table itself, read-only at the PDE in both
+               directories; the table's reference count is the number of
+               sharers. Whichever side first writes into (or remaps) the
+               region gets its own copy, and only then are the PTEs
+               marked COW and their frames referenced. */
+            uint32_t pde = (src_pde & ~PAGE_WRITE) | PAGE_SHARED_TABLE;
+            src->entries[i] = pde;
+            new_dir->entries[i] = pde;
+            pmm_ref_frame(src_pde & 0xFFFFF000U);
+            shared = 1;
         }
     }
 
-    /* Copy kernel mappings (PDE 768-1023 = kernel space at 3GB+) */
-    for (uint32_t i = 768U; i < 1024U; i++) {
+    /* Copy kernel mappings (PDE 768 up to the per-directory foreign and
+       recursive slots) */
+    for (uint32_t i = 768U; i < VMM_FOREIGN_SLOT; i++) {
         new_dir->entries[i] = src->entries[i];
     }
 
-    vga_print("[+] Page directory cloned successfully\n");
+    /* The parent's writable translations of the whole user range are
+       stale now */
+    if (shared && src_is_current) {
+        vmm_flush_tlb_user();
+    }
+
     return new_dir;
 }
 
+/* Copy-on-write fault counters */
+static uint32_t cow_copies = 0;
+static uint32_t cow_reuses = 0;
+
 /* Handle COW page fault */
 int vmm_handle_cow_fault(uint32_t fault_addr) {
     page_directory_t* current_dir = vmm_get_current_directory();
@@ -111,67 +146,64 @@ int vmm_handle_cow_fault(uint32_t fault_addr) {
         return -1;
     }
 
+    /* A write into a table still shared after fork first gets this
+       directory a private table, which marks the page COW if it was
+       writable; with no other sharer left the page is writable now */
+    if ((current_dir->entries[vmm_cow_get_table_index(fault_addr)] &
+         PAGE_SHARED_TABLE) != 0U) {
+        if (vmm_unshare_page_table(
+                current_dir, vmm_cow_get_table_index(fault_addr)) != 0) {
+            return -1;
+        }
+        pte = vmm_cow_get_pte(current_dir, fault_addr);
+        if ((*pte & (PAGE_PRESENT | PAGE_WRITE)) ==
+            (PAGE_PRESENT | PAGE_WRITE)) {
+            return 0;
+        }
+    }
+
     if (((*pte & PAGE_PRESENT) == 0U) || ((*pte & PAGE_COW) == 0U)) {
         return -1;  /* Not a COW page */
     }
-    
-    /* Get physical address of the original page */
-    uint32_t original_phys = *pte & 0xFFFFF000;
-    
-    /* Allocate new frame for the copy */
-    uint32_t new_phys = pmm_alloc_frame();
-    if (new_phys == 0) {
-        vga_print("[-] Failed to allocate frame for COW\n");
-        return -1;
-    }
 
-    /* Allocate temporary mapping slots */
-    int temp_slot_src = vmm_alloc_temp_slot();
-    int temp_slot_dest = vmm_alloc_temp_slot();
+    uint32_t page = fault_addr & 0xFFFFF000U;
+    uint32_t original_phys = *pte & 0xFFFFF000U;
+    uint32_t flags = (*pte & 0xFFFU & ~PAGE_COW) | PAGE_WRITE;
 
-    if (temp_slot_src < 0) {
-        vga_print("[-] Failed to allocate temp slot for COW\n");
-        pmm_free_frame(new_phys);
+    /* Sole owner: the other sharers exited or already took their own
+       copies, so the page just becomes writable again */
+    if (pmm_get_ref_count(original_phys) == 1U) {
+        *pte = original_phys | flags;
+        vmm_flush_tlb(page);
+        cow_reuses++;
+        return 0;
+    }
+
+    uint32_t new_phys = pmm_alloc_frame();
+    if (new_phys == 0U) {
+        vga_print("[-] Failed to allocate frame for COW\n");
         return -1;
     }
 
-    if (temp_slot_dest < 0) {
-        vga_print("[-] Failed to allocate temp slot for COW\n");
-        vmm_free_temp_slot(temp_slot_src);
+    /* The page is still mapped read-only at its user address in the live
+       directory, so only the copy needs a kmap slot */
+    uint32_t dest = vmm_kmap_atomic(new_phys);
+    if (dest == 0U) {
         pmm_free_frame(new_phys);
         return -1;
     }
+    memcpy((void*)dest, (void*)page, PAGE_SIZE);
+    vmm_kunmap_atomic(dest);
 
-    /* Temporarily map pages to copy data */
-    uint32_t temp_virt_src = vmm_map_temp_page(original_phys, temp_slot_src);
-    uint32_t temp_virt_dest = vmm_map_temp_page(new_phys, temp_slot_dest);
-
-    /* Copy data from original page to new page */
-    /* Note: Both source and destination are properly mapped pages of PAGE_SIZE (4096 bytes),
-     * so copying PAGE_SIZE bytes is safe and will not overflow */
-    memcpy((void*)temp_virt_dest, (void*)temp_virt_src, PAGE_SIZE);
-
-    /* Unmap temporary pages */
-    vmm_unmap_temp_page(temp_slot_src);
-    vmm_unmap_temp_page(temp_slot_dest);
-    vmm_free_temp_slot(temp_slot_src);
-    vmm_free_temp_slot(temp_slot_dest);
-
-    /* Preserve flags when updating PTE */
-    uint32_t flags = (*pte & ~(PAGE_COW | PAGE_WRITE)) | PAGE_WRITE;
     *pte = new_phys | flags;
+    vmm_flush_tlb(page);
 
-    /* Decrement reference count for original frame */
-    pmm_unref_frame(original_phys);
+    /* Drop this mapping's reference; the frame is freed if the other
+       sharers have gone since */
+    pmm_free_frame(original_phys);
+    cow_copies++;
 
-    /* Flush TLB */
-    vmm_flush_tlb(fault_addr);
-    
-    vga_print("[+] COW page fault handled for address 0x");
-    vga_print_hex(fault_addr);
-    vga_print("\n");
-    
-    return 0;  /* Handled successfully */
+    return 0;
 }
 
 /* Check if page is COW */
@@ -187,6 +219,12 @@ int vmm_is_page_cow(uint32_t virt_addr) {
         return 0;
     }
 
+    /* Writable pages of a table shared after fork are COW too */
+    if ((current_dir->entries[vmm_cow_get_table_index(virt_addr)] &
+         PAGE_SHARED_TABLE) != 0U) {
+        return ((*pte) & (PAGE_WRITE | PAGE_COW)) != 0U;
+    }
+
     return ((*pte) & PAGE_COW) != 0U;
 }
 
@@ -202,6 +240,9 @@ void vmm_get_stats(vmm_stats_t* stats) {
     stats->free_pages = 0;
     stats->cow_pages = 0;
     stats->shared_pages = 0;
+    stats->shared_tables = 0;
+    stats->cow_copies = cow_copies;
+    stats->cow_reuses = cow_reuses;
     
     /* Count pages in current directory */
     page_directory_t* current_dir = vmm_get_current_directory();
@@ -209,13 +250,20 @@ void vmm_get_stats(vmm_stats_t* stats) {
         return;
     }
 
-    for (uint32_t i = 0; i < 1024U; i++) {
+    /* The foreign and recursive slots map page tables, not pages */
+    for (uint32_t i = 0; i < VMM_FOREIGN_SLOT; i++) {
         uint32_t pde = current_dir->entries[i];
 
-        if ((pde & PAGE_PRESENT) != 0U) {
-            page_table_t* pt =
-                (page_table_t*)((pde & 0xFFFFF000U) + KERNEL_VIRT_START);
-            
+        if (((pde & PAGE_PRESENT) != 0U) && ((pde & PAGE_LARGE) != 0U)) {
+            stats->total_pages += 1024U;
+            stats->used_pages += 1024U;
+        } else if ((pde & PAGE_PRESENT) != 0U) {
+            page_table_t* pt = vmm_get_page_table(current_dir, i);
+
+            if ((pde & PAGE_SHARED_TABLE) != 0U) {
+                stats->shared_tables++;
+            }
+
             for (uint32_t j = 0; j < 1024U; j++) {
                 uint32_t pte = pt->entries[j];
 
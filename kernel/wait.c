@@ -5,6 +5,8 @@
 #include <kernel/process.h>
 #include <kernel/vga.h>
 #include <kernel/scheduler.h>
+#include <kernel/uaccess.h>
+#include <kernel/errno.h>
 
 #define WAIT_ANY ((pid_t)0xFFFFFFFFU)
 
@@ -52,10 +54,11 @@ pid_t do_wait(pid_t pid, int* status) {
         vga_print("\n");
 
         if (status != 0) {
-            /* Validate status pointer is in user space */
-            if ((uint32_t)status < 0xC0000000U) {
-                /* For now, we can't write to user space without temp mappings */
-                /* In a real system, we'd use temporary mappings here */
+            /* Leave the zombie in place if the status cannot be stored */
+            int exit_status = (int)child->exit_code;
+            if (copy_to_user(status, &exit_status, sizeof(exit_status)) != 0) {
+                vga_print("[-] wait: Bad status pointer\n");
+                return -EFAULT;
             }
         }
 